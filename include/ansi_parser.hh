@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class OutputBuffer;
+
+// Streaming decoder for terminal output. Printable text reaches the
+// OutputBuffer in runs tagged with the current SGR style; carriage returns,
+// cursor moves and erases edit the buffer's screen, and every other escape
+// sequence is dropped. Sequences and UTF-8 characters may be split across
+// reads, and feed() never allocates.
+class AnsiParser
+{
+public:
+    // A style packs fg and bg as palette index + 1 (0 = default) plus flags
+    static constexpr uint32_t COLOR_MASK = 0x1ff;
+    static constexpr int BACKGROUND_SHIFT = 9;
+    static constexpr uint32_t BOLD = 1u << 18;
+    static constexpr uint32_t DIM = 1u << 19;
+    static constexpr uint32_t ITALIC = 1u << 20;
+    static constexpr uint32_t UNDERLINE = 1u << 21;
+    static constexpr uint32_t REVERSE = 1u << 22;
+
+    // Palette index, or -1 for the default colour
+    static int foreground(uint32_t style);
+    static int background(uint32_t style);
+
+    AnsiParser();
+
+    void feed(const char *data, size_t length, OutputBuffer &output);
+    void reset();
+
+private:
+    enum class State
+    {
+        GROUND,
+        ESCAPE,
+        ESCAPE_SKIP, // one more byte, e.g. the charset after ESC (
+        CSI,
+        STRING,      // OSC, DCS and friends, up to BEL or ST
+        STRING_ESCAPE
+    };
+
+    void execute_control(char ch, OutputBuffer &output);
+    void escape_final(char ch, OutputBuffer &output);
+    void csi_byte(char ch, OutputBuffer &output);
+    void dispatch_csi(char final, OutputBuffer &output);
+    void apply_sgr();
+    int param(int index, int fallback) const;
+    void set_color(int shift, int color);
+
+    static constexpr int MAX_PARAMS = 16;
+
+    State state;
+    int params[MAX_PARAMS]; // -1 when omitted
+    int param_count;
+    bool private_marker;
+    uint32_t style;
+    char partial[4]; // a character whose last bytes are still to come
+    int partial_length;
+};
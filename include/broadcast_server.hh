@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class EventLoop;
+
+// Fans the presenter's messages out to any number of followers from a
+// thread of its own. Handing over a message costs the presenter one queue
+// push and one wakeup however many followers there are; the thread writes
+// each follower's share without blocking. Followers keep queues of shared
+// message buffers, so a message is stored once, and one that falls more
+// than MAX_BACKLOG behind is disconnected: it reconnects and is sent the
+// current state instead of everything it missed.
+class BroadcastServer
+{
+public:
+    static const size_t MAX_BACKLOG = 1 << 20;
+
+    BroadcastServer();
+    ~BroadcastServer();
+
+    BroadcastServer(const BroadcastServer &) = delete;
+    BroadcastServer &operator=(const BroadcastServer &) = delete;
+
+    // Takes over a listening socket and starts serving it
+    bool start(int listen_fd, std::string &error);
+    void stop();
+
+    // The calls below are for the presenter's thread
+    void broadcast(std::string data);
+    // A follower receives nothing until it has been sent the state this way
+    void send_to(uint64_t follower, std::string data);
+    // Readable while followers have connected that take_joined() has not returned
+    int joined_fd() const;
+    void take_joined(std::vector<uint64_t> &followers);
+    size_t get_follower_count() const;
+
+private:
+    struct Outgoing
+    {
+        uint64_t target; // 0: every follower that has its state
+        std::shared_ptr<const std::string> data;
+    };
+
+    struct Follower
+    {
+        int fd = -1;
+        bool ready = false; // has been sent the state
+        bool waiting_to_write = false;
+        std::deque<std::shared_ptr<const std::string>> queue;
+        size_t offset = 0; // into queue.front()
+        size_t queued_bytes = 0;
+    };
+
+    void run();
+    void accept_followers();
+    void deliver();
+    void queue_for(Follower &follower, const std::shared_ptr<const std::string> &data);
+    void write_to(uint64_t id);
+    void drop(uint64_t id);
+    void post(Outgoing outgoing);
+
+    std::thread thread;
+    std::atomic<bool> stopping;
+    std::atomic<size_t> follower_count;
+    int listen_fd;
+    int wake_fd;   // eventfd: messages to deliver, or stop
+    int joined_event_fd; // eventfd: followers to send the state to
+
+    std::mutex mutex; // guards outgoing and joined
+    std::vector<Outgoing> outgoing;
+    std::vector<uint64_t> joined;
+
+    // Used by the thread only
+    EventLoop *loop;
+    std::unordered_map<uint64_t, Follower> followers;
+    uint64_t next_id;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+struct RecordedChunk
+{
+    uint32_t ms; // since the command started
+    std::string data;
+};
+
+struct CommandRecording
+{
+    std::vector<RecordedChunk> chunks;
+    uint32_t duration_ms = 0;
+    std::string status; // "exit 0", "killed by signal 9"
+};
+
+// Timed output of shell commands, kept in a sidecar file next to the deck
+// so a presentation can replay its demos without running anything
+class CommandRecorder
+{
+public:
+    // The sidecar for deck.md is deck.md.output
+    static std::string sidecar_path(const std::string &deck_filename);
+
+    // A missing file is only an error when it is required
+    bool load(const std::string &filename, bool required, std::string &error);
+    bool save(const std::string &filename) const;
+
+    void store(const std::string &command, CommandRecording recording);
+    const CommandRecording *find(const std::string &command) const;
+    bool has_changes() const;
+
+private:
+    std::map<std::string, CommandRecording> recordings;
+    bool changed = false;
+};
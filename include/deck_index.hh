@@ -0,0 +1,58 @@
+#pragma once
+
+#include "slide_element.hh"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Inverted index over the words of every slide. Words are runs of ASCII
+// letters and digits or non-ASCII bytes, compared ASCII-lowercased. The
+// vocabulary is kept sorted, so a prefix selects a contiguous range of
+// words and a query costs its posting lists, not the deck size.
+class DeckIndex
+{
+public:
+    struct Query
+    {
+        std::vector<std::string> terms; // the last one also matches as a prefix
+    };
+
+    struct Result
+    {
+        int slide;
+        float score;
+    };
+
+    void build(const SlideCollection &slides);
+    bool is_empty() const;
+
+    static Query parse_query(std::string_view text);
+    // Slides containing every term, best first: header words weigh more and
+    // rare words more than common ones. Returns how many slides matched;
+    // results holds the best limit of them.
+    size_t search(const Query &query, size_t limit, std::vector<Result> &results);
+    // Byte ranges of the words in text that the query matches
+    static void match_ranges(const Query &query, std::string_view text,
+                             std::vector<std::pair<size_t, size_t>> &ranges);
+
+private:
+    struct Posting
+    {
+        uint32_t slide;
+        float weight; // occurrences, header ones counted more
+    };
+
+    // Word ids whose word equals term or, for a prefix, starts with it
+    std::pair<size_t, size_t> word_range(const std::string &term, bool prefix) const;
+
+    std::vector<std::string> words;             // sorted vocabulary
+    std::vector<std::vector<Posting>> postings; // per word, by slide
+    int slide_count = 0;
+
+    // Per-query scratch, sized to the deck
+    std::vector<float> scores;
+    std::vector<uint32_t> matched_terms;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "markdown_parser.hh"
+#include "slide_element.hh"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Assembles one deck from Markdown files, directories (their *.md files in
+// name order) and glob patterns. A line "<!-- include: path -->" ends the
+// current slide and inserts the slides of path, which may itself be a
+// directory or a pattern and is relative to the including file.
+//
+// Files are read and parsed on worker threads, one include level at a time.
+// Each parsed file is cached under its real path with its modification time
+// and size, so loading again re-parses only the files that changed. Include
+// paths are expanded again on every load, so files added to an included
+// directory or matching an included pattern are picked up.
+class DeckLoader
+{
+public:
+    explicit DeckLoader(const MarkdownParser &parser);
+
+    // On failure slides is left as it was and error says why
+    bool load(const std::vector<std::string> &paths, SlideCollection &slides, std::string &error);
+    // Files the last load() had to parse; the others came from the cache
+    size_t get_parsed_count() const;
+    size_t get_file_count() const;
+
+private:
+    struct ParsedFile
+    {
+        int64_t mtime_ns = 0;
+        int64_t size = -1;
+        std::vector<std::vector<SlideElement>> slides;
+        // Before slide index first, the path of an include line as written
+        std::vector<std::pair<size_t, std::string>> includes;
+        std::string error;
+    };
+
+    static bool expand(const std::string &path, const std::string &base_dir, std::vector<std::string> &files);
+    void parse_file(const std::string &path, ParsedFile &file) const;
+    void parse_files(const std::vector<std::string> &paths, std::vector<std::shared_ptr<ParsedFile>> &files) const;
+    void assemble(const std::string &path, std::vector<std::string> &open_files, SlideCollection &slides) const;
+
+    const MarkdownParser &parser;
+    std::map<std::string, std::shared_ptr<const ParsedFile>> cache;
+    // The files each include line of a cached file matched at the last load
+    std::map<std::string, std::vector<std::vector<std::string>>> include_files;
+    size_t parsed_count;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sys/epoll.h>
+
+// epoll-based dispatcher for the UI: stdin, timerfds and any other fds the
+// presenter has to react to. Blocks in the kernel while nothing happens.
+class EventLoop
+{
+public:
+    using Handler = std::function<void(uint32_t events)>;
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    void add_fd(int fd, Handler handler, uint32_t events = EPOLLIN);
+    void modify_fd(int fd, uint32_t events);
+    void remove_fd(int fd);
+
+    // Periodic timer backed by a timerfd; the returned fd is passed to remove_timer()
+    int add_timer(int initial_ms, int interval_ms, std::function<void()> handler);
+    void remove_timer(int timer_fd);
+
+    // Called when a signal interrupts the wait (SIGWINCH, SIGUSR1, ...)
+    void set_interrupt_handler(std::function<void()> handler);
+
+    // Waits up to timeout_ms (-1 = forever) and dispatches ready handlers
+    void run_once(int timeout_ms = -1);
+    // Runs nest; stop() ends the innermost run and the one below carries on
+    void run();
+    void stop();
+    bool is_stopped() const;
+
+    // Runs a modal view until it calls stop(): keys and signals go to
+    // on_input, while every other fd and timer keeps being served
+    void run_modal(std::function<void()> on_input);
+    bool in_modal() const;
+
+private:
+    int epoll_fd;
+    bool stopped;
+    int depth;  // nested run() calls
+    int modals; // of which run_modal()
+    std::map<int, std::shared_ptr<Handler>> handlers;
+    std::function<void()> interrupt_handler;
+};
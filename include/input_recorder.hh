@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Records every key read during a session and plays it back, so a real talk
+// can be run again against another build as a benchmark. All key reads go
+// through read_key() in place of getch().
+//
+// A recording is "mdslides-input 1\n", the screen size, then one record per
+// key: the microseconds since the previous key, the key code and, for
+// KEY_RESIZE, the new size, all as LEB128 varints. A key takes 3-5 bytes.
+//
+// On replay stdin is replaced by a pipe holding one byte per key that is
+// due, so the event loops wake up as they would for the keyboard. At speed
+// 0 the next key is due as soon as the last one has been read, but each
+// wakeup is given only one. Resizes are replayed with their recorded size, whatever
+// the size of the terminal, so stdout may be redirected.
+class InputRecorder
+{
+public:
+    static InputRecorder &instance();
+
+    bool record(const std::string &filename, std::string &error);
+    // speed: x times faster than recorded, 0 = as fast as keys are read
+    bool replay(const std::string &filename, double speed, std::string &error);
+    // Once the screen is set up: notes or restores its size and starts the clock
+    void start();
+    // getch(), honouring nodelay(stdscr)
+    int read_key();
+    // Writes the recording; after a replay, reports how long it took
+    bool close();
+
+    bool is_recording() const { return recording; }
+    bool is_replaying() const { return replaying; }
+
+private:
+    InputRecorder();
+
+    struct Key
+    {
+        uint64_t delta_us;
+        int key;
+        int lines; // KEY_RESIZE only
+        int cols;
+    };
+
+    int next_replayed_key();
+    void release_keys();
+    void release_one();
+
+    bool recording;
+    bool replaying;
+    std::string filename;
+    std::string encoded; // the recording so far
+    std::chrono::steady_clock::time_point origin;
+    std::chrono::steady_clock::time_point last_key;
+
+    std::vector<Key> keys;
+    int start_lines;
+    int start_cols;
+    double speed;
+    size_t next_key;
+    bool key_just_read;
+    int release_fd; // write end of the pipe on stdin
+    std::thread releaser;
+    std::mutex stop_mutex;
+    std::condition_variable stop_condition;
+    bool stopping;
+};
@@ -8,12 +8,14 @@ class MarkdownParser
 {
 public:
     MarkdownParser();
-    void load_slides(const std::string &filename, SlideCollection &slides);
     void set_utf8_support(bool enabled);
 
+    // The text of one slide, without its --- separators. Safe to call from
+    // several threads at once; DeckLoader parses files in parallel.
+    void parse_slide(const std::string &content, std::vector<SlideElement> &elements) const;
+
 private:
-    void parse_slide(const std::string &content, SlideCollection &slides);
-    void parse_slide_with_cmark(const std::string &content, SlideCollection &slides);
+    void parse_slide_with_cmark(const std::string &content, std::vector<SlideElement> &elements) const;
     void parse_slide_direct(const std::string &content, SlideCollection &slides);
     void load_char_replacements();
     bool detect_utf8_support();
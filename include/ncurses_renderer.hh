@@ -21,25 +21,56 @@ public:
                      bool show_timer, int minutes, int seconds, bool utf8_mode) override;
     void draw_footer() override;
     void draw_progress_bar(int current_slide, int total_slides) override;
+    void invalidate_chrome() override;
     void show_help(bool utf8_supported) override;
     void show_message(const std::string &message, int y = -1) override;
     void clear_message_area() override;
+    void draw_stats_overlay(const std::string &text) override;
+    void draw_notes_panel(const std::vector<std::string> &notes, const std::string &next_slide) override;
 
     int get_input() override;
+    int poll_input() override;
     int get_screen_width() const override;
     int get_screen_height() const override;
     void enable_echo() override;
     void disable_echo() override;
     void get_string(char *buffer, int max_length) override;
 
-    void apply_theme(Theme theme) override;
+    void apply_theme(int theme_index) override;
+    int get_theme_count() const override;
+    std::string get_theme_name(int theme_index) const override;
+    const ThemeConfig &get_theme_config(int theme_index) const override;
+    bool load_themes(const std::string &filename, std::string &error) override;
     void refresh_display() override;
+    void begin_frame() override;
+    void end_frame() override;
     void sleep_ms(int milliseconds) override;
 
     // UTF-8 support
     void set_utf8_support(bool enabled);
 
 private:
+    // Last drawn header, footer and progress bar; each part is redrawn
+    // only when its inputs change or its rows were overwritten
+    struct ChromeState
+    {
+        bool header_valid = false;
+        bool footer_valid = false;
+        bool progress_valid = false;
+        int screen_width = 0;
+        int screen_height = 0;
+        int slide = -1;
+        int total_slides = 0;
+        std::string theme_name;
+        bool utf8_mode = false;
+        bool show_timer = false;
+        int minutes = 0;
+        int seconds = 0;
+        int progress_width = 0;
+    };
+
+    void check_chrome_size();
+    void present();
     void safe_mvprintw(int y, int x, const std::string &text);
     void render_element_animated(const SlideElement &element);
     void render_element_instant(const SlideElement &element);
@@ -50,6 +81,13 @@ private:
     // Theme management
     ThemeManager theme_manager;
 
+    // Nesting depth of begin_frame()/end_frame()
+    int frame_depth;
+    ChromeState chrome;
+
+    // get_string() echoes by itself, so replayed keys show as typed ones do
+    bool echo_input;
+
     // UTF-8 and character handling
     bool utf8_supported;
     std::vector<std::pair<std::string, std::string>> char_replacements;
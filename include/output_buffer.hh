@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Line store for command output. The bottom screen_rows lines form an
+// editable screen that terminal output (carriage returns, cursor moves,
+// erases) can rewrite; lines that scroll off it are final. The most recent
+// lines live in a fixed-size ring; with spilling enabled every final line is
+// also appended to unlinked temporary files (text, styles and their line
+// offsets), and older lines are read back through mmap. Memory stays flat
+// whatever the output size. Should a spill file come up short (disk full),
+// spilling stops and the older lines are dropped, as without it.
+//
+// Text is kept as UTF-8 and the cursor counts display cells, so cursor
+// moves, tab stops and overwrites line up with wide and combining
+// characters; an overwrite replaces whole code points only.
+class OutputBuffer
+{
+public:
+    // style applies from byte start up to the next run; see AnsiParser for the packing
+    struct StyleRun
+    {
+        uint32_t start;
+        uint32_t style;
+    };
+
+    // Bytes in the UTF-8 sequence led by lead; 1 for ASCII and stray bytes
+    static int sequence_length(unsigned char lead);
+    // Cells taken by the character at text[at], 0 for a combining mark, and
+    // at moved past it; a byte that starts no valid sequence takes one cell
+    static int next_char(std::string_view text, size_t &at);
+
+    explicit OutputBuffer(size_t ring_lines = 10000);
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    bool enable_spill(std::string &error);
+    bool is_spilling() const;
+    // Height of the editable screen, normally the pty's rows
+    void set_screen_rows(int rows);
+
+    // Plain text: only '\n' is interpreted
+    void append(const char *data, size_t length);
+    void append(const std::string &data);
+    void clear();
+
+    // Terminal operations; rows and columns are 0-based screen positions.
+    // data holds whole code points.
+    void write_text(const char *data, size_t length, uint32_t style);
+    void line_feed();
+    void carriage_return();
+    void move_cursor(int row, int column);
+    void move_cursor_by(int rows, int columns);
+    void erase_in_line(int mode);
+    void erase_in_display(int mode);
+    int get_cursor_row() const;
+    int get_cursor_column() const;
+
+    // Lines are numbered from 0 over the whole output
+    size_t line_count() const;
+    // Oldest line still retrievable: 0 when spilling, else the ring's tail
+    size_t first_line() const;
+    // Valid until the buffer is next modified
+    std::string_view line(size_t index);
+    // Empty for lines in the default style
+    void line_styles(size_t index, std::vector<StyleRun> &runs);
+
+    // Lowest line added or rewritten since clear_changes(), or SIZE_MAX
+    size_t first_changed_line() const;
+    void clear_changes();
+
+private:
+    struct Line
+    {
+        std::string text;
+        std::vector<StyleRun> styles;
+        int cells = 0; // display width of text
+    };
+
+    struct SpillFile
+    {
+        int fd = -1;
+        uint64_t size = 0;      // bytes in the file; only these are mapped
+        char *map = nullptr;
+        uint64_t mapped = 0;    // bytes currently mapped
+        std::string pending;    // written on flush
+        bool failed = false;    // a write came up short; nothing more is written
+
+        bool create(std::string &error);
+        // Offset the next write lands at
+        uint64_t end() const { return size + pending.size(); }
+        void write(const char *data, size_t length);
+        bool flush();
+        const char *view(uint64_t end);
+        void close_file();
+    };
+
+    Line &slot(size_t index);
+    void mark_changed(size_t index);
+    Line &materialize(size_t index);
+    static size_t byte_at(const std::string &text, int column, int &start);
+    void overwrite(Line &target, int column, const char *data, size_t length, int width, uint32_t style);
+    void scroll_screen(size_t new_top);
+    void close_spill();
+    bool spill_failed() const;
+    bool spilled_range(SpillFile &index_file, SpillFile &data_file, size_t index, uint64_t &start,
+                       uint64_t &end);
+
+    std::vector<Line> ring;
+    size_t total_lines;
+    size_t screen_top;  // first line of the editable screen
+    int screen_rows;
+    int cursor_row;     // relative to screen_top
+    int cursor_column;  // in cells
+    std::vector<uint32_t> byte_styles; // scratch for rewriting a styled line
+    size_t changed_from;
+
+    bool spilling;
+    SpillFile spill_text;        // line bytes, each followed by '\n'
+    SpillFile spill_text_index;  // uint64_t start offset of each final line
+    SpillFile spill_styles;      // StyleRun records
+    SpillFile spill_styles_index;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "output_buffer.hh"
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Substring search over command output, smart-case like less: a pattern
+// without capitals matches either case. Candidates are found with memchr
+// or memmem, which scan many bytes per step, so re-running the search on
+// every keystroke stays cheap even over long output.
+class OutputSearch
+{
+public:
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+    OutputSearch();
+
+    void set_pattern(const std::string &pattern);
+    const std::string &get_pattern() const;
+    bool is_active() const;
+
+    // Offset of the first match in text at or after from, or NOT_FOUND
+    size_t find(std::string_view text, size_t from = 0) const;
+    // First line in [from, to) with a match, scanning forward or backward
+    size_t find_line(OutputBuffer &buffer, size_t from, size_t to) const;
+    size_t find_line_backward(OutputBuffer &buffer, size_t from, size_t to) const;
+
+private:
+    bool matches_at(const char *text) const;
+
+    std::string pattern;
+    bool ignore_case;
+    unsigned char first_lower, first_upper;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "output_buffer.hh"
+#include "output_search.hh"
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct _win_st; // ncurses' WINDOW
+
+// A scrollable window onto an OutputBuffer. The position is a (line,
+// wrapped row) pair and lines are wrapped only while they are on screen,
+// so scrolling and drawing cost one screenful whatever the output size.
+// The visible rows are kept rendered in a pad: scrolling shifts it and
+// renders only the rows coming into view, and new output re-renders only
+// the rows of lines that changed.
+class OutputView
+{
+public:
+    OutputView();
+
+    // Starts at the top, following new output
+    void set_buffer(OutputBuffer *buffer);
+    void set_area(int y, int x, int height, int width);
+
+    void scroll_up(int rows);
+    void scroll_down(int rows);
+    void scroll_to_start();
+    void scroll_to_end();
+    // After output was appended: keep following, or stay inside the ring
+    void update();
+    // Scrolls just enough to bring line to the top, unless it is already in view
+    void show_line(size_t line);
+    // Matches of search are shown reversed; nullptr turns highlighting off
+    void set_highlight(const OutputSearch *search);
+
+    // After a theme change: output colours are matched to the new theme and
+    // every view renders its pad again on its next draw
+    static void reset_colors();
+
+    // Brings the pad up to date and copies it over the area of stdscr;
+    // unstyled text uses color_pair
+    void draw(int color_pair);
+
+    int get_height() const;
+    int get_width() const;
+    size_t get_top_line() const;
+    // One past the last line drawn, counting a partly shown line
+    size_t get_end_line() const;
+    bool more_above() const;
+    bool more_below() const;
+
+private:
+    struct PadDeleter
+    {
+        void operator()(_win_st *pad) const;
+    };
+
+    int rows_of(size_t line);
+    bool step_forward(size_t &line, int &row);
+    bool step_back(size_t &line, int &row);
+    int rows_between(size_t from_line, int from_row, size_t to_line, int to_row, int limit);
+    void scroll_pad(int color_pair);
+    void render_rows(int first, int count, size_t line, int row, int color_pair);
+    void find_matches(std::string_view text);
+    void draw_styled(std::string_view text, size_t start, size_t end, int color_pair);
+
+    OutputBuffer *buffer;
+    int area_y, area_x, area_height, area_width;
+    size_t top_line; // first output line on screen
+    int top_row;     // wrapped row of top_line shown first
+    bool following;  // keep the newest output in view
+    size_t end_line;
+    bool has_more_below;
+    std::vector<OutputBuffer::StyleRun> styles; // of the line being drawn
+    const OutputSearch *highlight;
+    std::vector<std::pair<size_t, size_t>> matches; // of the line being drawn
+
+    std::unique_ptr<_win_st, PadDeleter> pad;
+    bool pad_valid;
+    size_t pad_line; // position rendered in the pad's first row
+    int pad_row;
+    int pad_color_pair;
+    int pad_generation; // of the output colours the pad was rendered with
+};
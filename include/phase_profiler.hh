@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+enum class Phase
+{
+    LOAD_SLIDES,
+    PARSE_SLIDE,
+    LAYOUT,
+    RENDER_SLIDE,
+    DRAW_HEADER,
+    DRAW_FOOTER,
+    DRAW_PROGRESS,
+    REFRESH,
+    INDEX_DECK,
+    SEARCH_DECK,
+    EXPORT_SLIDE,
+    COUNT
+};
+
+// Log-linear histogram over nanoseconds: every power of two is split into
+// eight sub-buckets, so percentiles are accurate to about 12%.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+    void record(uint64_t nanoseconds);
+    uint64_t percentile(double fraction) const;
+    uint64_t get_count() const;
+    uint64_t get_max() const;
+    uint64_t get_mean() const;
+
+private:
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr int BUCKET_COUNT = 64 << SUB_BUCKET_BITS;
+
+    static int bucket_index(uint64_t value);
+    static uint64_t bucket_midpoint(int index);
+
+    std::array<uint64_t, BUCKET_COUNT> buckets;
+    uint64_t count;
+    uint64_t total;
+    uint64_t max_value;
+};
+
+class PhaseProfiler
+{
+public:
+    static PhaseProfiler &instance();
+
+    void set_enabled(bool enabled);
+    bool is_enabled() const { return enabled; }
+    void record(Phase phase, uint64_t nanoseconds);
+    bool write_json(const std::string &filename) const;
+
+    static const char *phase_name(Phase phase);
+
+private:
+    PhaseProfiler();
+
+    bool enabled;
+    std::mutex record_mutex; // slides are parsed on several threads
+    std::array<LatencyHistogram, static_cast<int>(Phase::COUNT)> histograms;
+};
+
+// Times the enclosing scope into the profiler and, when tracing, emits a
+// trace span for it; a single branch when both are disabled
+class ScopedPhase
+{
+public:
+    explicit ScopedPhase(Phase phase);
+    ~ScopedPhase();
+
+    ScopedPhase(const ScopedPhase &) = delete;
+    ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+private:
+    Phase phase;
+    bool profiling;
+    bool tracing;
+    std::chrono::steady_clock::time_point start;
+    uint64_t trace_start_us;
+};
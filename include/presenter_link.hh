@@ -0,0 +1,92 @@
+#pragma once
+
+#include "broadcast_server.hh"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class EventLoop;
+
+// Keeps other mdslides instances, the one on the projector or a whole
+// workshop's worth, in step with the presenting one over a Unix domain
+// socket. The presenter listens and sends every change as a small message as
+// soon as it happens: the slide shown, the timer, and command output as it
+// is read. Each follower renders them at its own terminal size. A follower
+// that connects is first sent the current state, then only changes.
+//
+// On the wire a message is one header line, "<kind> <slide> <element>
+// <value> <length>\n", followed by length bytes of text.
+class PresenterLink
+{
+public:
+    enum class Kind : char
+    {
+        DECK = 'D',        // value: slide count; the follower reloads its files
+        SLIDE = 'S',       // slide
+        TIMER = 'T',       // value: elapsed ms, or -1 while the timer is hidden
+        JOB_START = 'J',   // slide, element (-1: the popup); text: the command
+        JOB_OUTPUT = 'O',  // slide, element; text: raw output
+        JOB_END = 'E',     // slide, element; text: the final status
+        POPUP_CLOSE = 'C', // the popup was closed
+    };
+
+    struct Message
+    {
+        Kind kind;
+        int slide;
+        int element;
+        int64_t value;
+        std::string text;
+
+        Message(Kind kind = Kind::SLIDE, int slide = 0, int element = 0, int64_t value = 0, std::string text = "")
+            : kind(kind), slide(slide), element(element), value(value), text(std::move(text))
+        {
+        }
+    };
+
+    PresenterLink();
+    ~PresenterLink();
+
+    PresenterLink(const PresenterLink &) = delete;
+    PresenterLink &operator=(const PresenterLink &) = delete;
+
+    // Presenter side; followers are served by a BroadcastServer thread. state
+    // fills in what a follower needs when it connects.
+    bool listen(const std::string &path, EventLoop &loop, std::function<void(std::vector<Message> &)> state,
+                std::string &error);
+    // Follower side: connects, and again every second while there is no presenter
+    void follow(const std::string &path, EventLoop &loop, std::function<void(const Message &)> handler,
+                std::function<void(bool connected)> connection_handler);
+    // To every follower; costs the same however many there are
+    void send(const Message &message);
+    void close();
+
+    bool is_presenter() const;
+    bool is_follower() const;
+    bool is_connected() const;
+    size_t get_follower_count() const;
+
+private:
+    void send_state();
+    void drop_peer();
+    void try_connect();
+    void read_messages();
+    static void encode(const Message &message, std::string &out);
+    // Decodes the first message in data; 0 when it is incomplete, -1 when malformed
+    static long decode(const std::string &data, size_t start, Message &message);
+
+    EventLoop *loop;
+    std::string socket_path;
+    bool presenting;
+    bool following;
+    std::unique_ptr<BroadcastServer> server; // when presenting
+    int peer_fd;         // the presenter, when following
+    int retry_timer_fd;
+    std::string inbox;   // received, not yet a whole message
+    std::function<void(std::vector<Message> &)> state_source;
+    std::function<void(const Message &)> message_handler;
+    std::function<void(bool)> connection_handler;
+};
@@ -21,12 +21,19 @@ public:
                              bool show_timer, int minutes, int seconds, bool utf8_mode) = 0;
     virtual void draw_footer() = 0;
     virtual void draw_progress_bar(int current_slide, int total_slides) = 0;
+    // Forces the next header/footer/progress bar calls to redraw, e.g. after a popup
+    virtual void invalidate_chrome() = 0;
     virtual void show_help(bool utf8_supported) = 0;
     virtual void show_message(const std::string &message, int y = -1) = 0;
     virtual void clear_message_area() = 0;
+    virtual void draw_stats_overlay(const std::string &text) = 0;
+    // Presenter view: the slide's speaker notes and what comes next, at the bottom of the slide area
+    virtual void draw_notes_panel(const std::vector<std::string> &notes, const std::string &next_slide) = 0;
 
     // Input handling
     virtual int get_input() = 0;
+    // Returns the next buffered key without blocking, or ERR when there is none
+    virtual int poll_input() = 0;
     virtual int get_screen_width() const = 0;
     virtual int get_screen_height() const = 0;
     virtual void enable_echo() = 0;
@@ -34,9 +41,16 @@ public:
     virtual void get_string(char *buffer, int max_length) = 0;
 
     // Theme management
-    virtual void apply_theme(Theme theme) = 0;
+    virtual void apply_theme(int theme_index) = 0;
+    virtual int get_theme_count() const = 0;
+    virtual std::string get_theme_name(int theme_index) const = 0;
+    virtual const ThemeConfig &get_theme_config(int theme_index) const = 0;
+    virtual bool load_themes(const std::string &filename, std::string &error) = 0;
 
     // Utility methods
     virtual void refresh_display() = 0;
+    // Draw calls between begin_frame() and end_frame() reach the terminal in one flush
+    virtual void begin_frame() = 0;
+    virtual void end_frame() = 0;
     virtual void sleep_ms(int milliseconds) = 0;
 };
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "ansi_parser.hh"
+#include "command_recorder.hh"
+#include "output_buffer.hh"
+#include "shell_process.hh"
+#include "shell_session.hh"
+#include <chrono>
+#include <functional>
+#include <string>
+
+struct ShellJobOptions
+{
+    bool spill_output = false;
+    CommandRecorder *recorder = nullptr; // completed runs are stored here
+    bool replay = false;                 // play the recorder's output instead of running
+    double replay_speed = 1.0;           // 0 replays instantly
+    bool use_pty = true;                 // else a plain pipe
+    int rows = 24;                       // pty size, normally the output view's
+    int columns = 80;
+    ShellSession *session = nullptr;     // run here when it is idle, else in a fresh shell
+};
+
+// One run of a shell command: the process, its output and how it ended.
+// Whoever owns the job watches output_fd() and calls read_available(); a
+// replayed job hands out a timer instead of a pipe.
+class ShellJob
+{
+public:
+    explicit ShellJob(const std::string &command);
+    ~ShellJob();
+
+    // Errors end up in the output and the status, so the job is always displayable
+    void start(const ShellJobOptions &options);
+    // Reads what is available; false once the command has finished
+    bool read_available();
+    void stop();
+    // Follows the output view to a new size
+    void resize(int rows, int columns);
+
+    // Passes raw output on as it is read, and the final status once the job
+    // ends. Output read before this is passed on first, as plain text.
+    void set_listener(std::function<void(const std::string &chunk)> on_output,
+                      std::function<void(const std::string &status)> on_end);
+    // A job that runs elsewhere, e.g. on the presenter this instance follows;
+    // its output and its end are handed in instead of read
+    void start_mirror(int rows);
+    void mirror_output(const std::string &chunk);
+    void mirror_end(const std::string &final_status);
+
+    int output_fd() const;
+    bool is_running() const;
+    const std::string &get_command() const;
+    const std::string &get_status() const;
+    OutputBuffer &get_output();
+    // The output so far without its styles, one '\n' per line
+    std::string get_output_text();
+    std::chrono::steady_clock::time_point get_start_time() const;
+    std::chrono::steady_clock::time_point get_finish_time() const;
+
+private:
+    void start_replay(const CommandRecording *source, double speed);
+    bool replay_due();
+    void append(const std::string &chunk);
+    void finish(const std::string &how);
+    void notify_end();
+
+    std::string command;
+    std::string status;
+    ShellProcess process;
+    OutputBuffer output;
+    AnsiParser parser;
+    bool running;
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::time_point finish_time;
+
+    CommandRecorder *recorder;
+    CommandRecording recording;
+
+    ShellSession *session; // while the command runs in it
+
+    std::function<void(const std::string &)> output_listener;
+    std::function<void(const std::string &)> end_listener;
+
+    const CommandRecording *replay_source;
+    size_t replay_next; // next chunk; chunks.size() means the end event
+    double replay_speed;
+    int replay_timer_fd;
+};
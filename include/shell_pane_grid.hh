@@ -0,0 +1,58 @@
+#pragma once
+
+#include "shell_job.hh"
+#include "output_view.hh"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class EventLoop;
+
+// Runs several shell commands at once, each streaming into its own tile
+// with its elapsed time, so side-by-side demos take as long as the slowest
+class ShellPaneGrid
+{
+public:
+    ShellPaneGrid(int screen_width, int screen_height);
+
+    void set_job_options(const ShellJobOptions &options);
+    // Runs as a modal view on loop; prefetched may hold already started
+    // jobs for some commands (or nullptr)
+    void show(EventLoop &loop, const std::vector<std::string> &commands,
+              std::vector<std::unique_ptr<ShellJob>> prefetched = {});
+
+    // Called on KEY_RESIZE; expected to redraw the slide and call relayout()
+    void set_resize_handler(std::function<void()> handler);
+    // Recomputes geometry for a new screen size and redraws without refreshing
+    void relayout(int screen_width, int screen_height);
+
+private:
+    struct Pane
+    {
+        std::unique_ptr<ShellJob> job;
+        OutputView view;
+        int y, x, height, width;
+    };
+
+    void compute_geometry(int screen_width, int screen_height);
+    void layout_panes();
+    void start_pane(Pane &pane, const std::string &command);
+    void watch_pane(Pane &pane, EventLoop &loop);
+    void read_output(Pane &pane, EventLoop &loop);
+    void update_elapsed(EventLoop &loop);
+    void draw_all();
+    void draw_title();
+    void draw_pane_frame(int index);
+    void draw_pane_status(const Pane &pane);
+    void handle_input(EventLoop &loop);
+    bool handle_key(int ch, EventLoop &loop);
+    void clear_area();
+
+    std::vector<Pane> panes;
+    int focused;
+    int area_x, area_y, area_width, area_height;
+    int elapsed_timer_fd;
+    ShellJobOptions job_options;
+    std::function<void()> resize_handler;
+};
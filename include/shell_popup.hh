@@ -1,29 +1,75 @@
 #pragma once
 
 #include "slide_element.hh"
+#include "shell_job.hh"
+#include "output_view.hh"
+#include <functional>
+#include <memory>
 #include <vector>
 #include <string>
 
+class EventLoop;
+
 class ShellPopup
 {
 private:
     int popup_width, popup_height;
     int popup_x, popup_y;
-    int scroll_offset;
-    std::vector<std::string> output_lines;
+    std::unique_ptr<ShellJob> job;
+    bool prefetched; // job was started before the popup opened
+    OutputView view;
     std::string command;
-    bool is_running;
+
+    // '/' search: the pattern is edited at a prompt and matches stay highlighted
+    OutputSearch search;
+    bool search_prompt;
+    std::string search_input;
+    size_t search_origin;  // top line when the prompt opened
+    size_t match_line;     // OutputSearch::NOT_FOUND when nothing matched
+    size_t search_scanned; // streamed lines before this have been searched
+    ShellJobOptions job_options;
+    std::function<void(ShellJob &)> job_handler;
+    std::function<void()> resize_handler;
+    bool mirroring; // showing a presenter's job, without the keyboard
 
 public:
     ShellPopup(int screen_width, int screen_height);
 
-    void show(const std::string &cmd);
+    // Runs cmd, or continues from a job that was already started for it, as
+    // a modal view on loop
+    void show(EventLoop &loop, const std::string &cmd, std::unique_ptr<ShellJob> prefetched_job = nullptr);
+
+    // How new runs are started: output spilling, recording or replay
+    void set_job_options(const ShellJobOptions &options);
+    // Called with every job the popup shows, e.g. to set a listener on it
+    void set_job_handler(std::function<void(ShellJob &)> handler);
+
+    // Follower side: shows a job mirrored from the presenter and returns at
+    // once; update_mirror() draws output that arrived since
+    void show_mirror(std::unique_ptr<ShellJob> mirrored);
+    void update_mirror();
+    ShellJob &get_job();
+
+    // Called on KEY_RESIZE; expected to redraw the slide and call relayout()
+    void set_resize_handler(std::function<void()> handler);
+    // Recomputes geometry for a new screen size and redraws without refreshing
+    void relayout(int screen_width, int screen_height);
+
+    // Size of the output area, for commands started before a popup exists
+    static void output_size(int screen_width, int screen_height, int &rows, int &columns);
 
 private:
+    void compute_geometry(int screen_width, int screen_height);
     void draw_popup_frame();
-    void execute_command();
+    void execute_command(EventLoop &loop);
+    void rerun_command(EventLoop &loop);
+    void read_output(EventLoop &loop);
     void display_output();
-    void handle_input();
+    void draw_help_line();
+    bool handle_search_key(int ch);
+    void run_search(size_t from, bool forward);
+    void search_new_output();
+    void handle_input(EventLoop &loop);
+    bool handle_key(int ch, EventLoop &loop);
     void clear_popup_area();
-    std::string execute_shell_command(const std::string &command);
 };
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+
+// A shell command running as /bin/sh -c in its own process group, with
+// stdout and stderr merged into a nonblocking pipe, or into the master side
+// of a pseudo-terminal so the command colours its output as on a terminal.
+// The shell may outlive its output (e.g. after exec >&-), so the fd to
+// watch is an epoll fd: it holds the output, then the shell's exit.
+class ShellProcess
+{
+public:
+    ShellProcess();
+    ~ShellProcess();
+
+    ShellProcess(const ShellProcess &) = delete;
+    ShellProcess &operator=(const ShellProcess &) = delete;
+
+    // With pty_size the command runs on a new pseudo-terminal of that size;
+    // control_fd, if given, becomes the command's fd 3
+    bool start(const std::string &command, std::string &error, const winsize *pty_size = nullptr,
+               int control_fd = -1);
+
+    // Readable on output or, after end of output, once the shell exits; for
+    // an EventLoop. -1 once the shell is reaped.
+    int output_fd() const;
+
+    // Tells a command on a pty about a new size; SIGWINCH follows
+    void resize(int rows, int columns);
+
+    // Appends whatever is available without blocking; false once the output
+    // has ended and the shell has exited
+    bool read_available(std::string &output);
+
+    // SIGKILLs the whole process group and reaps the shell
+    void kill_group();
+    void signal_group(int signal_number);
+
+    // How the shell ended, once read_available() returned false
+    std::string wait_status();
+
+    bool is_running() const;
+
+private:
+    void close_output();
+    bool start_pty(const std::string &command, std::string &error, const winsize &size, int control_fd);
+    bool watch_output(std::string &error);
+    bool reap_without_blocking();
+    void close_watch();
+
+    pid_t pid;
+    int read_fd;
+    int watch_fd; // epoll fd over read_fd, then exit_fd
+    int exit_fd;  // pidfd of the shell, or a polling timerfd without pidfds
+    int exit_status;
+    bool on_pty;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "shell_process.hh"
+#include <string>
+
+// One long-lived /bin/sh that runs a deck's commands in turn, so cd,
+// exported variables and activated virtualenvs carry over between fences.
+// Commands travel over a socket on the shell's fd 3; after each one the
+// shell prints an escape sequence with a per-command nonce and $? to its
+// output, which marks the end of that command's output.
+class ShellSession
+{
+public:
+    ShellSession();
+    ~ShellSession();
+
+    ShellSession(const ShellSession &) = delete;
+    ShellSession &operator=(const ShellSession &) = delete;
+
+    // The shell is started on first use (again, if it exited)
+    void set_use_pty(bool enabled);
+    bool run(const std::string &command, int rows, int columns, std::string &error);
+
+    // Output of the running command, for an EventLoop
+    int output_fd() const;
+    // Appends output without blocking; false once the command has finished,
+    // with how set to e.g. "exit 0"
+    bool read_output(std::string &output, std::string &how);
+    // SIGINTs the command and waits briefly for the shell to come back,
+    // restarting the session if it does not
+    void interrupt();
+    void resize(int rows, int columns);
+
+    bool is_busy() const;
+
+private:
+    bool start(int rows, int columns, std::string &error);
+    void end_session();
+    size_t partial_marker_length() const;
+
+    ShellProcess process;
+    int control_fd;     // our end of the shell's fd 3
+    bool use_pty;
+    bool busy;
+    std::string marker; // start of the end-of-command sequence for the running command
+    std::string pending;
+};
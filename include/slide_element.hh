@@ -20,7 +20,8 @@ enum class ElementType
     NUMBERED,
     CODE_BLOCK,
     SHELL_COMMAND,
-    SHELL_OUTPUT
+    SHELL_OUTPUT,
+    NOTE // <!-- speaker notes -->, shown only in the presenter view
 };
 
 struct SlideElement
@@ -35,10 +36,10 @@ struct SlideElement
 
     // Shell command specific
     std::string shell_command;
-    bool executed = false;
-    std::vector<std::string> shell_output_lines;
-    int output_scroll_offset = 0;
-    int max_output_lines = 5;
+    bool prefetch = false; // ```$!prefetch: start while the previous slide is shown
+    bool inline_output = false; // ```$!inline[=rows]: output shows under the fence
+    bool executed = false;      // SHELL_OUTPUT: has output to show instead of the placeholder
+    int max_output_lines = 5;   // rows of the inline output pane
 };
 
 class SlideCollection
@@ -51,6 +52,11 @@ public:
     bool is_empty() const;
     void clear();
 
+    // Recomputes width-dependent positions if the slide was laid out for
+    // another screen width; other slides are only relaid out when visited
+    void ensure_layout(int index, int screen_width);
+
 private:
     std::vector<std::vector<SlideElement>> slides;
+    std::vector<int> layout_widths;
 };
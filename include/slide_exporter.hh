@@ -0,0 +1,50 @@
+#pragma once
+
+#include "slide_element.hh"
+#include "theme_config.hh"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+enum class ExportFormat
+{
+    ANSI, // SGR colours, for cat or less -R
+    TEXT,
+    HTML
+};
+
+// Renders every slide of a deck, without a terminal, at a given width and
+// in one theme's colours. Slides are rendered on all cores into a cell
+// grid each, as tall as the slide's content, and written in order: text
+// and ANSI slides are separated by form feeds, HTML slides are sections
+// of one page.
+class SlideExporter
+{
+public:
+    SlideExporter(ExportFormat format, int width, const ThemeConfig &theme);
+
+    // "ansi", "txt" or "html"
+    static bool parse_format(const std::string &name, ExportFormat &format);
+
+    bool write(SlideCollection &slides, FILE *out, std::string &error) const;
+
+private:
+    struct Cell
+    {
+        const char *text = nullptr; // UTF-8 bytes in the element; blank when null
+        uint8_t length = 0;         // 0 with text set: right half of a wide character
+        uint8_t pair = 0;
+        bool bold = false;
+        bool dim = false;
+    };
+
+    std::string render_slide(const std::vector<SlideElement> &elements) const;
+    void put_element(const SlideElement &element, std::vector<Cell> &grid) const;
+    void append_style(std::string &out, const Cell &cell) const;
+    std::string html_header(const std::string &title) const;
+
+    ExportFormat format;
+    int width;
+    ThemeConfig theme;
+};
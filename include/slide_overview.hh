@@ -0,0 +1,62 @@
+#pragma once
+
+#include "slide_element.hh"
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+class EventLoop;
+struct _win_st; // ncurses' WINDOW
+
+// Tiles miniature slides across the screen for picking one. Each thumbnail
+// is rendered once into a pad and kept for as long as the theme and the
+// tile size stay the same, so paging only copies pads; tiles that are not
+// on screen are never rendered.
+class SlideOverview
+{
+public:
+    SlideOverview();
+
+    // Runs as a modal view on loop. The chosen slide, or -1 when the
+    // overview was closed without choosing.
+    int show(EventLoop &loop, const SlideCollection &slides, int current_slide, int theme, int screen_width,
+             int screen_height);
+
+    // Called on KEY_RESIZE; expected to redraw the slide and call relayout()
+    void set_resize_handler(std::function<void()> handler);
+    // Recomputes geometry for a new screen size and redraws without refreshing
+    void relayout(int screen_width, int screen_height);
+    // Drops all thumbnails, after the slides changed
+    void invalidate();
+
+private:
+    struct PadDeleter
+    {
+        void operator()(_win_st *pad) const;
+    };
+
+    void compute_geometry(int screen_width, int screen_height);
+    _win_st *thumbnail(int slide);
+    void render_thumbnail(_win_st *pad, int slide);
+    void scroll_to_selection();
+    void draw();
+    void draw_tile(int slide, int y, int x);
+    void handle_input(EventLoop &loop);
+    bool handle_key(int ch);
+
+    const SlideCollection *slides;
+    int selected;
+    int first_row; // grid row shown at the top
+    int chosen;
+
+    int area_x, area_y, area_width, area_height;
+    int columns, rows;                // tiles on screen
+    int tile_width, tile_height;      // including the border
+    int thumb_width, thumb_height;    // the miniature inside it
+
+    // Thumbnails by slide, for cache_theme and the current thumbnail size
+    std::unordered_map<int, std::unique_ptr<_win_st, PadDeleter>> thumbnails;
+    int cache_theme;
+    int cache_width, cache_height;
+    std::function<void()> resize_handler;
+};
@@ -3,9 +3,19 @@
 #include "slide_element.hh"
 #include "theme_config.hh"
 #include "markdown_parser.hh"
+#include "deck_loader.hh"
 #include "renderer_interface.hh"
 #include "shell_command_selector.hh"
+#include "terminal_stats.hh"
+#include "event_loop.hh"
+#include "shell_job.hh"
+#include "output_view.hh"
+#include "deck_index.hh"
+#include "slide_overview.hh"
+#include "presenter_link.hh"
+#include "shell_popup.hh"
 #include <chrono>
+#include <map>
 #include <string>
 #include <memory>
 
@@ -13,8 +23,27 @@ class MarkdownSlideRenderer
 {
 public:
     MarkdownSlideRenderer();
-    void load_slides(const std::string &filename);
+    // Files, directories or glob patterns, assembled into one deck
+    bool load_slides(const std::vector<std::string> &paths, std::string &error);
     void run();
+    // Writes every slide to stdout as "ansi", "txt" or "html" instead of presenting
+    bool export_slides(const std::string &format, int width, std::string &error);
+    void set_stats_summary(bool enabled);
+    void set_latency_json(const std::string &filename);
+    bool set_trace_file(const std::string &filename);
+    bool load_themes(const std::string &filename, std::string &error);
+    void set_output_spill(bool enabled);
+    void set_use_pty(bool enabled);
+    void set_shell_session(bool enabled);
+    bool record_output(const std::string &filename, std::string &error);
+    bool replay_output(const std::string &filename, double speed, std::string &error);
+    // Every key of the session, with its timing, for replaying it as a benchmark
+    bool record_input(const std::string &filename, std::string &error);
+    bool replay_input(const std::string &filename, double speed, std::string &error);
+    // Presenter view: notes, next slide and timer here, while a follower
+    // started with follow_presenter() shows the slides
+    bool start_presenter_view(const std::string &socket_path, std::string &error);
+    void follow_presenter(const std::string &socket_path);
 
 private:
     ShellCommandSelector shell_selector;
@@ -25,22 +54,104 @@ private:
     void start_shell_command_selection();
     bool handle_shell_selection_input(int ch);
     void execute_selected_shell_command();
+    void run_all_shell_commands();
+    std::unique_ptr<ShellJob> take_prefetched_job(const std::string &command);
+    void prefetch_upcoming_commands();
+    void stop_prefetch_jobs();
+    void run_inline_command(int output_index);
+    void read_inline_output(int slide, int output_index);
+    void draw_inline_pane(int slide, int output_index);
+    void draw_inline_panes();
+    void scroll_inline_pane(bool up);
+    void stop_inline_jobs();
+    void mirror_job(ShellJob &job, int slide, int element);
+    void presenter_state(std::vector<PresenterLink::Message> &state);
+    PresenterLink::Message timer_message() const;
+    void handle_presenter_message(const PresenterLink::Message &message);
+    void start_mirrored_job(int slide, int element, const std::string &command);
+    ShellJob *find_mirrored_job(int slide, int element);
+    void draw_mirrored_job(int slide, int element);
+    void draw_presenter_notes();
 
     std::string execute_shell_command(const std::string &command);
 
     // Navigation and UI
+    void process_pending_input();
+    bool handle_key(int ch);
+    bool apply_navigation_key(int ch, int &target, bool &jumped) const;
+    void begin_key(int ch);
+    void end_key();
+    void update_timer_tick();
+    void write_latency_json();
     void goto_slide();
+    void search_slides();
+    void reload_slides();
+    bool reload_deck(std::string &error);
+    void show_overview();
+    void handle_resize();
     void render_current_slide(bool animated);
+    void draw_chrome();
     void get_timer_values(int &minutes, int &seconds);
     std::string get_current_theme_name();
 
     // Member variables
     SlideCollection slides;
     MarkdownParser parser;
+    DeckLoader deck_loader; // keeps every file parsed, for 'R'
+    std::vector<std::string> deck_paths;
+    DeckIndex deck_index; // built when the slides are loaded, for '/'
+    SlideOverview overview; // keeps its thumbnails between openings
     std::unique_ptr<ISlideRenderer> renderer;
     int current_slide;
     bool show_timer;
     std::chrono::steady_clock::time_point start_time;
     bool utf8_supported;
-    Theme current_theme;
+    int current_theme;
+    bool use_animations;
+
+    // How shell commands run: spilling, recording to or replaying from a sidecar,
+    // and optionally one shell session shared by the whole deck
+    ShellJobOptions job_options;
+    CommandRecorder command_recorder;
+    std::string recording_file;
+    ShellSession shell_session;
+
+    // Main loop: stdin, the once-per-second timer tick and other fds
+    EventLoop event_loop;
+    int timer_fd;
+
+    // !prefetch commands of the next slide, run ahead of ENTER, keyed by command
+    std::map<std::string, std::unique_ptr<ShellJob>> prefetch_jobs;
+    int prefetched_for_slide;
+    bool prefetch_refused_shown;
+
+    // Runs of !inline commands, keyed by slide and SHELL_OUTPUT element index.
+    // They are kept for the whole presentation, so output is still there
+    // when its slide is shown again.
+    struct InlinePane
+    {
+        std::unique_ptr<ShellJob> job;
+        OutputView view;
+    };
+    std::map<std::pair<int, int>, InlinePane> inline_panes;
+    std::pair<int, int> scrolled_pane; // last run; u/d scroll it while its slide is shown
+
+    // Presenter view and the follower it drives. The follower mirrors the
+    // presenter's commands rather than running them, including the popup.
+    PresenterLink presenter_link;
+    std::string follow_socket;
+    int sent_slide; // last slide the follower was told about
+    std::unique_ptr<ShellPopup> mirrored_popup;
+
+    // Terminal output accounting
+    TerminalStats output_stats;
+    bool show_stats_summary;
+    bool show_stats_overlay;
+
+    // Per-phase latency histograms, written on exit and on SIGUSR1
+    std::string latency_json_file;
+
+    // Key-to-screen tracing: the key being handled and when it arrived
+    int pending_key;
+    uint64_t key_received_us;
 };
\ No newline at end of file
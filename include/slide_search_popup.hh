@@ -0,0 +1,51 @@
+#pragma once
+
+#include "deck_index.hh"
+#include "slide_element.hh"
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+class EventLoop;
+
+// '/' over the whole deck: results are re-ranked on every keystroke and
+// listed as slide number, title and the best matching line, with the
+// matched words highlighted
+class SlideSearchPopup
+{
+public:
+    SlideSearchPopup(int screen_width, int screen_height);
+
+    // Runs as a modal view on loop. The chosen slide, or -1 when the search
+    // was cancelled.
+    int show(EventLoop &loop, DeckIndex &index, const SlideCollection &slides);
+
+    // Called on KEY_RESIZE; expected to redraw the slide and call relayout()
+    void set_resize_handler(std::function<void()> handler);
+    // Recomputes geometry for a new screen size and redraws without refreshing
+    void relayout(int screen_width, int screen_height);
+
+private:
+    void compute_geometry(int screen_width, int screen_height);
+    void run_query();
+    void draw();
+    void draw_result(int row, const DeckIndex::Result &result, bool is_selected);
+    int draw_highlighted(int y, int x, const std::string &text, int width, int attrs);
+    void handle_input(EventLoop &loop);
+    bool handle_key(int ch);
+    void clear_popup_area();
+
+    int popup_x, popup_y, popup_width, popup_height;
+    DeckIndex *index;
+    const SlideCollection *slides;
+
+    std::string input;
+    DeckIndex::Query query;
+    std::vector<DeckIndex::Result> results;
+    size_t match_count;
+    int selected;
+    int chosen;
+    std::vector<std::pair<size_t, size_t>> ranges; // scratch for draw_highlighted
+    std::function<void()> resize_handler;
+};
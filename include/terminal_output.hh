@@ -0,0 +1,26 @@
+#pragma once
+
+#include "terminal_stats.hh"
+#include <cstdio>
+
+// Stands between ncurses and the terminal. ncurses draws into a pipe and a
+// thread copies it to the terminal, counting the bytes and write(2) calls
+// on the way. Behind the pipe ncurses cannot see the terminal, so its
+// modes and window size are handled here: cbreak and noecho are set on
+// open, and SIGWINCH is caught here instead of by ncurses.
+class TerminalOutput
+{
+public:
+    // The stream for newterm(); nullptr when no pipe could be set up
+    static FILE *open();
+    // After endwin(): forwards what is left and restores the terminal modes
+    static void close();
+
+    // What has reached the terminal, once everything drawn so far has
+    static OutputCounters totals();
+
+    // The terminal's size; false when there is no terminal to ask
+    static bool get_size(int &lines, int &cols);
+    // True once per SIGWINCH, with the new size
+    static bool take_resize(int &lines, int &cols);
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct OutputCounters
+{
+    uint64_t bytes = 0;
+    uint64_t writes = 0;
+};
+
+struct SlideOutputStats
+{
+    uint64_t frames = 0;
+    OutputCounters total;
+    OutputCounters max_frame;
+};
+
+// Counts bytes and write(2) calls that reach the terminal. A frame is one
+// full slide draw, an action is everything done in response to one key.
+class TerminalStats
+{
+public:
+    TerminalStats();
+
+    void begin_action();
+    void end_action();
+    void begin_frame();
+    void end_frame(int slide_index);
+
+    const OutputCounters &get_last_action() const;
+    std::string format_overlay() const;
+    std::string format_summary(int top_slides = 10) const;
+
+private:
+    OutputCounters action_start;
+    OutputCounters frame_start;
+    OutputCounters last_action;
+    OutputCounters action_total;
+    OutputCounters max_action;
+    uint64_t action_count;
+    bool action_open;
+    std::vector<SlideOutputStats> slides;
+};
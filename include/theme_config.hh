@@ -1,8 +1,10 @@
 #pragma once
 
+#include <map>
 #include <vector>
 #include <string>
 
+// Built-in themes, in cycling order; themes loaded from a palette file follow
 enum class Theme
 {
     DARK,
@@ -11,22 +13,41 @@ enum class Theme
     RETRO
 };
 
+// Colour values are 0-255 palette indices or THEME_RGB | 0xRRGGBB
+constexpr int THEME_RGB = 1 << 24;
+
 struct ThemeConfig
 {
     int bg_color, title_color, subtitle_color, text_color, accent_color, code_color;
-    const char *name;
+    std::string name;
 };
 
 class ThemeManager
 {
 public:
     ThemeManager();
-    void setup_theme(Theme theme);
+    void setup_theme(int theme_index);
     void cycle_theme();
-    Theme get_current_theme() const;
+    int get_current_theme() const;
     const char *get_current_theme_name() const;
+    int get_theme_count() const;
+    const char *get_theme_name(int theme_index) const;
+    const ThemeConfig &get_theme_config(int theme_index) const;
+
+    // Adds (or replaces, by name) themes from an INI-style palette file
+    bool load_palette_file(const std::string &filename, std::string &error);
+
+    // Terminal colour number for a palette index or THEME_RGB value
+    static int resolve_color(int value);
+    static int nearest_palette_index(int rgb);
+    static void init_color_pair(int pair, int foreground, int background);
+    // Colour values of a colour pair (0-9) in a theme, before resolve_color()
+    static void pair_colors(const ThemeConfig &theme, int pair, int &foreground, int &background);
+    // 0xRRGGBB of a palette index or THEME_RGB value
+    static int rgb_of_color(int value);
 
 private:
     std::vector<ThemeConfig> themes;
-    Theme current_theme;
+    int current_theme;
+    bool background_set;
 };
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Collects spans in memory and writes them as Chrome Trace Event JSON
+// (loadable in Perfetto or chrome://tracing) when closed.
+class TraceRecorder
+{
+public:
+    static TraceRecorder &instance();
+
+    bool open(const std::string &filename);
+    bool close();
+    bool is_enabled() const { return enabled; }
+
+    uint64_t now_us() const;
+    void complete(const char *name, const char *category, uint64_t start_us, uint64_t end_us,
+                  int arg = -1);
+    void instant(const char *name, const char *category, int arg = -1);
+
+private:
+    TraceRecorder();
+
+    struct TraceEvent
+    {
+        const char *name;
+        const char *category;
+        char phase;
+        uint64_t timestamp_us;
+        uint64_t duration_us;
+        int thread_id;
+        int arg;
+    };
+
+    int current_thread_id();
+
+    bool enabled;
+    std::string filename;
+    std::chrono::steady_clock::time_point origin;
+    std::mutex events_mutex;
+    std::vector<TraceEvent> events;
+};
@@ -0,0 +1,51 @@
+#!/bin/sh
+# Checks that mdslides sleeps while nothing happens. With the timer
+# ticking, an inline pane streaming output under it and a popup open, it
+# may use only a few clock ticks of CPU over an idle interval.
+#
+# Usage: scripts/check_idle_cpu.sh [path/to/mdslides]   (needs tmux)
+
+MDSLIDES=$(realpath "${1:-build/mdslides}")
+IDLE_SECONDS=5
+MAX_TICKS=10 # utime + stime, in clock ticks (usually 10 ms each)
+
+command -v tmux >/dev/null || { echo "tmux is needed"; exit 2; }
+[ -x "$MDSLIDES" ] || { echo "No executable at $MDSLIDES"; exit 2; }
+
+DIR=$(mktemp -d)
+SESSION=idle-cpu-$$
+trap 'tmux kill-session -t $SESSION 2>/dev/null; rm -rf "$DIR"' EXIT
+
+cat >"$DIR/deck.md" <<'DECK'
+# Idle
+```$!inline while sleep 0.5; do date; done
+```
+
+```$sleep 60
+```
+DECK
+
+tmux new-session -d -s $SESSION -x 100 -y 30 "$MDSLIDES $DIR/deck.md"
+sleep 1
+PID=$(tmux list-panes -t $SESSION -F '#{pane_pid}')
+
+# Timer on, run the inline command, then select the second one for a popup
+tmux send-keys -t $SESSION T Enter Enter
+sleep 0.5
+tmux send-keys -t $SESSION Enter Down Enter
+sleep 1
+
+cpu_ticks()
+{
+    # Fields 14 and 15 of /proc/PID/stat, counted after the parenthesised name
+    sed 's/.*) //' "/proc/$1/stat" | awk '{ print $12 + $13 }'
+}
+
+before=$(cpu_ticks "$PID")
+sleep $IDLE_SECONDS
+after=$(cpu_ticks "$PID")
+used=$((after - before))
+
+tmux capture-pane -p -t $SESSION | grep -q 'Shell Command Execution' || { echo "The popup did not open"; exit 2; }
+echo "$used ticks of CPU in ${IDLE_SECONDS} s (at most $MAX_TICKS allowed)"
+[ "$used" -le "$MAX_TICKS" ]
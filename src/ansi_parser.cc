@@ -0,0 +1,357 @@
+#include "ansi_parser.hh"
+#include "output_buffer.hh"
+#include "theme_config.hh"
+#include <algorithm>
+
+int AnsiParser::foreground(uint32_t style)
+{
+    return (int)(style & COLOR_MASK) - 1;
+}
+
+int AnsiParser::background(uint32_t style)
+{
+    return (int)((style >> BACKGROUND_SHIFT) & COLOR_MASK) - 1;
+}
+
+AnsiParser::AnsiParser()
+{
+    reset();
+}
+
+void AnsiParser::reset()
+{
+    state = State::GROUND;
+    param_count = 0;
+    private_marker = false;
+    style = 0;
+    partial_length = 0;
+}
+
+void AnsiParser::feed(const char *data, size_t length, OutputBuffer &output)
+{
+    const char *end = data + length;
+    while (data < end)
+    {
+        if (state == State::GROUND)
+        {
+            if (partial_length > 0)
+            {
+                // Completed by this read, or cut short and written as it is
+                int needed = OutputBuffer::sequence_length(partial[0]);
+                while (data < end && partial_length < needed && ((unsigned char)*data & 0xc0) == 0x80)
+                    partial[partial_length++] = *data++;
+                if (data == end && partial_length < needed)
+                    break;
+                output.write_text(partial, partial_length, style);
+                partial_length = 0;
+            }
+
+            // Hand over printable text (including UTF-8) a run at a time
+            const char *text = data;
+            while (data < end && ((unsigned char)*data >= 0x20 && *data != 0x7f))
+                data++;
+            if (data == end)
+            {
+                // The buffer takes whole characters only
+                const char *lead = data;
+                while (lead > text && lead > data - 3 && ((unsigned char)lead[-1] & 0xc0) == 0x80)
+                    lead--;
+                if (lead > text && (unsigned char)lead[-1] >= 0xc0 &&
+                    OutputBuffer::sequence_length(lead[-1]) > data - lead + 1)
+                {
+                    partial_length = data - lead + 1;
+                    std::copy(lead - 1, data, partial);
+                    data = lead - 1;
+                }
+            }
+            output.write_text(text, data - text, style);
+            if (data == end || partial_length > 0)
+                break;
+        }
+
+        char ch = *data++;
+        switch (state)
+        {
+        case State::GROUND:
+            if (ch == 0x1b)
+                state = State::ESCAPE;
+            else
+                execute_control(ch, output);
+            break;
+
+        case State::ESCAPE:
+            escape_final(ch, output);
+            break;
+
+        case State::ESCAPE_SKIP:
+            state = State::GROUND;
+            break;
+
+        case State::CSI:
+            csi_byte(ch, output);
+            break;
+
+        case State::STRING:
+            if (ch == 0x07)
+                state = State::GROUND;
+            else if (ch == 0x1b)
+                state = State::STRING_ESCAPE;
+            break;
+
+        case State::STRING_ESCAPE:
+            // ESC \ ends the string; anything else starts a new sequence
+            if (ch == '\\')
+                state = State::GROUND;
+            else
+                escape_final(ch, output);
+            break;
+        }
+    }
+}
+
+void AnsiParser::execute_control(char ch, OutputBuffer &output)
+{
+    switch (ch)
+    {
+    case '\n':
+    case '\v':
+    case '\f':
+        // Pipes have no tty to add the carriage return
+        output.carriage_return();
+        output.line_feed();
+        break;
+
+    case '\r':
+        output.carriage_return();
+        break;
+
+    case '\b':
+        output.move_cursor_by(0, -1);
+        break;
+
+    case '\t':
+    {
+        int column = output.get_cursor_column();
+        output.move_cursor_by(0, (column / 8 + 1) * 8 - column);
+        break;
+    }
+
+    default:
+        break; // BEL, NUL and the rest have nothing to show
+    }
+}
+
+void AnsiParser::escape_final(char ch, OutputBuffer &output)
+{
+    state = State::GROUND;
+    switch (ch)
+    {
+    case '[':
+        state = State::CSI;
+        param_count = 1;
+        params[0] = -1;
+        private_marker = false;
+        break;
+
+    case ']':
+    case 'P':
+    case 'X':
+    case '^':
+    case '_':
+        state = State::STRING;
+        break;
+
+    case '(':
+    case ')':
+    case '*':
+    case '+':
+    case '#':
+    case '%':
+        state = State::ESCAPE_SKIP;
+        break;
+
+    case 0x1b:
+        state = State::ESCAPE;
+        break;
+
+    case 'D':
+        output.line_feed();
+        break;
+
+    case 'E':
+        output.carriage_return();
+        output.line_feed();
+        break;
+
+    case 'M':
+        output.move_cursor_by(-1, 0);
+        break;
+
+    case 'c':
+        style = 0;
+        break;
+
+    default:
+        break;
+    }
+}
+
+void AnsiParser::csi_byte(char ch, OutputBuffer &output)
+{
+    if (ch >= '0' && ch <= '9')
+    {
+        int &value = params[param_count - 1];
+        value = std::min(std::max(value, 0) * 10 + (ch - '0'), 65535);
+    }
+    else if (ch == ';' || ch == ':')
+    {
+        // Extra parameters are dropped rather than overflowing
+        if (param_count < MAX_PARAMS)
+            params[param_count++] = -1;
+    }
+    else if (ch >= '<' && ch <= '?')
+    {
+        private_marker = true;
+    }
+    else if (ch >= 0x40 && ch <= 0x7e)
+    {
+        state = State::GROUND;
+        dispatch_csi(ch, output);
+    }
+    else if (ch == 0x1b)
+    {
+        state = State::ESCAPE;
+    }
+    else if ((unsigned char)ch < 0x20)
+    {
+        execute_control(ch, output);
+    }
+    // Intermediate bytes (0x20-0x2f) select variants we do not implement
+}
+
+int AnsiParser::param(int index, int fallback) const
+{
+    if (index >= param_count || params[index] < 0)
+        return fallback;
+    return params[index];
+}
+
+void AnsiParser::dispatch_csi(char final, OutputBuffer &output)
+{
+    // Private modes (cursor visibility, alternate screen...) do not apply here
+    if (private_marker)
+        return;
+
+    int count = std::max(param(0, 1), 1);
+    switch (final)
+    {
+    case 'm':
+        apply_sgr();
+        break;
+
+    case 'A':
+        output.move_cursor_by(-count, 0);
+        break;
+
+    case 'B':
+    case 'e':
+        output.move_cursor_by(count, 0);
+        break;
+
+    case 'C':
+    case 'a':
+        output.move_cursor_by(0, count);
+        break;
+
+    case 'D':
+        output.move_cursor_by(0, -count);
+        break;
+
+    case 'E':
+        output.move_cursor(output.get_cursor_row() + count, 0);
+        break;
+
+    case 'F':
+        output.move_cursor(output.get_cursor_row() - count, 0);
+        break;
+
+    case 'G':
+    case '`':
+        output.move_cursor(output.get_cursor_row(), count - 1);
+        break;
+
+    case 'd':
+        output.move_cursor(count - 1, output.get_cursor_column());
+        break;
+
+    case 'H':
+    case 'f':
+        output.move_cursor(std::max(param(0, 1), 1) - 1, std::max(param(1, 1), 1) - 1);
+        break;
+
+    case 'J':
+        output.erase_in_display(param(0, 0));
+        break;
+
+    case 'K':
+        output.erase_in_line(param(0, 0));
+        break;
+
+    default:
+        break;
+    }
+}
+
+void AnsiParser::set_color(int shift, int color)
+{
+    style = (style & ~(COLOR_MASK << shift)) | ((uint32_t)(color + 1) << shift);
+}
+
+void AnsiParser::apply_sgr()
+{
+    for (int i = 0; i < param_count; ++i)
+    {
+        int code = param(i, 0);
+        int shift = (code / 10) % 2 == 0 ? BACKGROUND_SHIFT : 0; // 3x, 9x foreground; 4x, 10x background
+
+        if (code == 0)
+            style = 0;
+        else if (code == 1)
+            style |= BOLD;
+        else if (code == 2)
+            style |= DIM;
+        else if (code == 3)
+            style |= ITALIC;
+        else if (code == 4)
+            style |= UNDERLINE;
+        else if (code == 7)
+            style |= REVERSE;
+        else if (code == 21 || code == 22)
+            style &= ~(BOLD | DIM);
+        else if (code == 23)
+            style &= ~ITALIC;
+        else if (code == 24)
+            style &= ~UNDERLINE;
+        else if (code == 27)
+            style &= ~REVERSE;
+        else if ((code >= 30 && code <= 37) || (code >= 40 && code <= 47))
+            set_color(shift, code % 10);
+        else if ((code >= 90 && code <= 97) || (code >= 100 && code <= 107))
+            set_color(shift, 8 + code % 10);
+        else if (code == 39 || code == 49)
+            style &= ~(COLOR_MASK << shift);
+        else if ((code == 38 || code == 48) && param(i + 1, 0) == 5)
+        {
+            set_color(shift, std::min(param(i + 2, 0), 255));
+            i += 2;
+        }
+        else if ((code == 38 || code == 48) && param(i + 1, 0) == 2)
+        {
+            // Truecolour is folded into the 256-colour palette
+            int rgb = (std::min(param(i + 2, 0), 255) << 16) | (std::min(param(i + 3, 0), 255) << 8) |
+                      std::min(param(i + 4, 0), 255);
+            set_color(shift, ThemeManager::nearest_palette_index(rgb));
+            i += 4;
+        }
+    }
+}
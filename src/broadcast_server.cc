@@ -0,0 +1,293 @@
+#include "broadcast_server.hh"
+#include "event_loop.hh"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace
+{
+    const int MAX_IOVECS = 64;
+
+    void signal_event(int fd)
+    {
+        uint64_t one = 1;
+        ssize_t ignored = write(fd, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    void clear_event(int fd)
+    {
+        uint64_t count;
+        ssize_t ignored = read(fd, &count, sizeof(count));
+        (void)ignored;
+    }
+}
+
+BroadcastServer::BroadcastServer()
+    : stopping(false), follower_count(0), listen_fd(-1), wake_fd(-1), joined_event_fd(-1), loop(nullptr), next_id(1)
+{
+}
+
+BroadcastServer::~BroadcastServer()
+{
+    stop();
+}
+
+bool BroadcastServer::start(int fd, std::string &error)
+{
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    joined_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0 || joined_event_fd < 0)
+    {
+        error = std::string("Cannot create eventfd: ") + strerror(errno);
+        return false;
+    }
+    listen_fd = fd;
+    stopping = false;
+
+    // Signals (SIGWINCH, SIGUSR1, ...) stay with the UI thread
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &previous);
+    thread = std::thread([this]()
+                         { run(); });
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    return true;
+}
+
+void BroadcastServer::stop()
+{
+    if (thread.joinable())
+    {
+        stopping = true;
+        signal_event(wake_fd);
+        thread.join();
+    }
+    for (int *fd : {&listen_fd, &wake_fd, &joined_event_fd})
+    {
+        if (*fd >= 0)
+            close(*fd);
+        *fd = -1;
+    }
+}
+
+void BroadcastServer::broadcast(std::string data)
+{
+    post({0, std::make_shared<const std::string>(std::move(data))});
+}
+
+void BroadcastServer::send_to(uint64_t follower, std::string data)
+{
+    post({follower, std::make_shared<const std::string>(std::move(data))});
+}
+
+void BroadcastServer::post(Outgoing message)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        outgoing.push_back(std::move(message));
+    }
+    signal_event(wake_fd);
+}
+
+int BroadcastServer::joined_fd() const
+{
+    return joined_event_fd;
+}
+
+void BroadcastServer::take_joined(std::vector<uint64_t> &ids)
+{
+    clear_event(joined_event_fd);
+    std::lock_guard<std::mutex> lock(mutex);
+    ids.swap(joined);
+    joined.clear();
+}
+
+size_t BroadcastServer::get_follower_count() const
+{
+    return follower_count;
+}
+
+void BroadcastServer::run()
+{
+    EventLoop thread_loop;
+    loop = &thread_loop;
+    loop->add_fd(listen_fd, [this](uint32_t)
+                 { accept_followers(); });
+    loop->add_fd(wake_fd, [this](uint32_t)
+                 {
+                     clear_event(wake_fd);
+                     if (stopping)
+                         loop->stop();
+                     else
+                         deliver();
+                 });
+    loop->run();
+
+    for (auto &entry : followers)
+    {
+        close(entry.second.fd);
+    }
+    followers.clear();
+    follower_count = 0;
+    loop = nullptr;
+}
+
+void BroadcastServer::accept_followers()
+{
+    std::vector<uint64_t> accepted;
+    int fd;
+    while ((fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        uint64_t id = next_id++;
+        followers[id].fd = fd;
+        loop->add_fd(fd, [this, id](uint32_t events)
+                     {
+                         if (events & EPOLLOUT)
+                             write_to(id);
+                         // Followers send nothing; readable means gone
+                         char ignored[256];
+                         auto found = followers.find(id);
+                         if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && found != followers.end() &&
+                             recv(found->second.fd, ignored, sizeof(ignored), 0) <= 0)
+                             drop(id);
+                     });
+        accepted.push_back(id);
+    }
+    if (accepted.empty())
+        return;
+
+    follower_count = followers.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        joined.insert(joined.end(), accepted.begin(), accepted.end());
+    }
+    signal_event(joined_event_fd);
+}
+
+void BroadcastServer::deliver()
+{
+    std::vector<Outgoing> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(outgoing);
+    }
+
+    // Everything that arrived together goes out in one write per follower.
+    // Broadcasts before a follower's state are already part of that state.
+    for (const auto &message : batch)
+    {
+        if (message.target == 0)
+        {
+            for (auto &entry : followers)
+            {
+                if (entry.second.ready)
+                    queue_for(entry.second, message.data);
+            }
+            continue;
+        }
+        auto found = followers.find(message.target);
+        if (found == followers.end())
+            continue;
+        found->second.ready = true;
+        queue_for(found->second, message.data);
+    }
+
+    // A follower this far behind catches up faster by starting over
+    std::vector<uint64_t> pending, lagging;
+    for (auto &entry : followers)
+    {
+        const Follower &follower = entry.second;
+        if (follower.queued_bytes - follower.offset > MAX_BACKLOG)
+            lagging.push_back(entry.first);
+        else if (!follower.queue.empty() && !follower.waiting_to_write)
+            pending.push_back(entry.first);
+    }
+    for (uint64_t id : lagging)
+    {
+        drop(id);
+    }
+    for (uint64_t id : pending)
+    {
+        write_to(id);
+    }
+}
+
+void BroadcastServer::queue_for(Follower &follower, const std::shared_ptr<const std::string> &data)
+{
+    follower.queue.push_back(data);
+    follower.queued_bytes += data->size();
+}
+
+void BroadcastServer::write_to(uint64_t id)
+{
+    auto found = followers.find(id);
+    if (found == followers.end())
+        return;
+    Follower &follower = found->second;
+    while (!follower.queue.empty())
+    {
+        iovec parts[MAX_IOVECS];
+        int count = 0;
+        for (auto it = follower.queue.begin(); it != follower.queue.end() && count < MAX_IOVECS; ++it, ++count)
+        {
+            size_t skip = count == 0 ? follower.offset : 0;
+            parts[count].iov_base = const_cast<char *>((*it)->data() + skip);
+            parts[count].iov_len = (*it)->size() - skip;
+        }
+
+        msghdr header = {};
+        header.msg_iov = parts;
+        header.msg_iovlen = count;
+        ssize_t sent = sendmsg(follower.fd, &header, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // Picked up again when the socket drains
+            if (!follower.waiting_to_write)
+                loop->modify_fd(follower.fd, EPOLLIN | EPOLLOUT);
+            follower.waiting_to_write = true;
+            return;
+        }
+        if (sent <= 0)
+        {
+            drop(id);
+            return;
+        }
+
+        size_t done = sent;
+        while (done > 0)
+        {
+            size_t left = follower.queue.front()->size() - follower.offset;
+            if (done < left)
+            {
+                follower.offset += done;
+                break;
+            }
+            done -= left;
+            follower.queued_bytes -= follower.queue.front()->size();
+            follower.queue.pop_front();
+            follower.offset = 0;
+        }
+    }
+
+    if (follower.waiting_to_write)
+        loop->modify_fd(follower.fd, EPOLLIN);
+    follower.waiting_to_write = false;
+}
+
+void BroadcastServer::drop(uint64_t id)
+{
+    auto found = followers.find(id);
+    if (found == followers.end())
+        return;
+    loop->remove_fd(found->second.fd);
+    close(found->second.fd);
+    followers.erase(found);
+    follower_count = followers.size();
+}
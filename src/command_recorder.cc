@@ -0,0 +1,133 @@
+#include "command_recorder.hh"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    const char *FILE_HEADER = "mdslides-output 1";
+    const size_t READ_CHUNK = 64 * 1024;
+
+    // Each record is "<kind> <fields...> <length>\n" followed by length bytes
+    // and "\n". A length past the end of the file is corrupt, and the bytes
+    // are read in chunks, so a bad length never allocates more than is there.
+    bool read_block(std::istream &in, uint64_t file_size, size_t length, std::string &data)
+    {
+        std::streamoff position = in.tellg();
+        if (position < 0 || length > file_size - (uint64_t)position)
+            return false;
+
+        data.clear();
+        while (data.size() < length)
+        {
+            size_t done = data.size();
+            size_t count = std::min(length - done, READ_CHUNK);
+            data.resize(done + count);
+            in.read(&data[done], count);
+            if (in.gcount() != (std::streamsize)count)
+                return false;
+        }
+        return in.get() == '\n';
+    }
+}
+
+std::string CommandRecorder::sidecar_path(const std::string &deck_filename)
+{
+    return deck_filename + ".output";
+}
+
+bool CommandRecorder::load(const std::string &filename, bool required, std::string &error)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in)
+    {
+        if (required)
+            error = "Cannot open recorded output: " + filename;
+        return !required;
+    }
+    in.seekg(0, std::ios::end);
+    uint64_t file_size = std::max<std::streamoff>(in.tellg(), 0);
+    in.seekg(0);
+
+    std::string line;
+    if (!std::getline(in, line) || line != FILE_HEADER)
+    {
+        error = filename + ": not a recorded output file";
+        return false;
+    }
+
+    std::string command;
+    CommandRecording recording;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string kind, data;
+        uint32_t ms = 0;
+        size_t length = 0;
+        fields >> kind;
+        if (kind != "command")
+            fields >> ms;
+        fields >> length;
+
+        if (!fields || !read_block(in, file_size, length, data))
+        {
+            error = filename + ": truncated or corrupt record";
+            return false;
+        }
+
+        if (kind == "command")
+        {
+            command = data;
+            recording = CommandRecording();
+        }
+        else if (kind == "chunk")
+        {
+            recording.chunks.push_back({ms, data});
+        }
+        else if (kind == "end")
+        {
+            recording.duration_ms = ms;
+            recording.status = data;
+            recordings[command] = std::move(recording);
+            recording = CommandRecording();
+        }
+    }
+    return true;
+}
+
+bool CommandRecorder::save(const std::string &filename) const
+{
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+
+    out << FILE_HEADER << "\n";
+    for (const auto &entry : recordings)
+    {
+        out << "command " << entry.first.size() << "\n" << entry.first << "\n";
+        for (const auto &chunk : entry.second.chunks)
+        {
+            out << "chunk " << chunk.ms << " " << chunk.data.size() << "\n" << chunk.data << "\n";
+        }
+        out << "end " << entry.second.duration_ms << " " << entry.second.status.size() << "\n"
+            << entry.second.status << "\n";
+    }
+    return static_cast<bool>(out.flush());
+}
+
+void CommandRecorder::store(const std::string &command, CommandRecording recording)
+{
+    recordings[command] = std::move(recording);
+    changed = true;
+}
+
+const CommandRecording *CommandRecorder::find(const std::string &command) const
+{
+    auto it = recordings.find(command);
+    return it == recordings.end() ? nullptr : &it->second;
+}
+
+bool CommandRecorder::has_changes() const
+{
+    return changed;
+}
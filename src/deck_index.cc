@@ -0,0 +1,208 @@
+#include "deck_index.hh"
+#include "phase_profiler.hh"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace
+{
+    bool is_word_byte(unsigned char c)
+    {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+    }
+
+    void to_lower(std::string &word)
+    {
+        for (char &c : word)
+        {
+            if (c >= 'A' && c <= 'Z')
+                c = c - 'A' + 'a';
+        }
+    }
+
+    // Calls found(start, end) for each word of text
+    template <typename Callback>
+    void for_each_word(std::string_view text, Callback found)
+    {
+        size_t i = 0;
+        while (i < text.size())
+        {
+            while (i < text.size() && !is_word_byte(text[i]))
+                ++i;
+            size_t start = i;
+            while (i < text.size() && is_word_byte(text[i]))
+                ++i;
+            if (i > start)
+                found(start, i);
+        }
+    }
+
+    float element_weight(ElementType type)
+    {
+        switch (type)
+        {
+        case ElementType::HEADER1:
+            return 4;
+        case ElementType::HEADER2:
+        case ElementType::HEADER3:
+            return 2;
+        default:
+            return 1;
+        }
+    }
+}
+
+void DeckIndex::build(const SlideCollection &slides)
+{
+    ScopedPhase timing(Phase::INDEX_DECK);
+    slide_count = slides.get_slide_count();
+
+    // Slides are visited in order, so every posting list comes out sorted
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<std::vector<Posting>> lists;
+    std::string word;
+    for (int slide = 0; slide < slide_count; ++slide)
+    {
+        for (const auto &element : slides.get_slide(slide))
+        {
+            if (element.type == ElementType::SHELL_OUTPUT || element.type == ElementType::NOTE)
+                continue; // a placeholder or speaker notes, not slide text
+
+            float weight = element_weight(element.type);
+            for_each_word(element.content, [&](size_t start, size_t end)
+                          {
+                              word.assign(element.content, start, end - start);
+                              to_lower(word);
+                              auto inserted = ids.emplace(word, (uint32_t)lists.size());
+                              if (inserted.second)
+                                  lists.emplace_back();
+
+                              std::vector<Posting> &list = lists[inserted.first->second];
+                              if (!list.empty() && list.back().slide == (uint32_t)slide)
+                                  list.back().weight += weight;
+                              else
+                                  list.push_back({(uint32_t)slide, weight});
+                          });
+        }
+    }
+
+    std::vector<std::pair<std::string, uint32_t>> sorted(ids.begin(), ids.end());
+    std::sort(sorted.begin(), sorted.end());
+    words.clear();
+    postings.clear();
+    words.reserve(sorted.size());
+    postings.reserve(sorted.size());
+    for (auto &entry : sorted)
+    {
+        words.push_back(std::move(entry.first));
+        postings.push_back(std::move(lists[entry.second]));
+    }
+
+    scores.assign(slide_count, 0);
+    matched_terms.assign(slide_count, 0);
+}
+
+bool DeckIndex::is_empty() const
+{
+    return words.empty();
+}
+
+DeckIndex::Query DeckIndex::parse_query(std::string_view text)
+{
+    Query query;
+    for_each_word(text, [&](size_t start, size_t end)
+                  {
+                      query.terms.emplace_back(text.substr(start, end - start));
+                      to_lower(query.terms.back());
+                  });
+    return query;
+}
+
+std::pair<size_t, size_t> DeckIndex::word_range(const std::string &term, bool prefix) const
+{
+    // Words starting with term follow it directly in sorted order
+    auto first = std::lower_bound(words.begin(), words.end(), term);
+    auto last = first;
+    if (prefix)
+    {
+        last = std::partition_point(first, words.end(), [&term](const std::string &word)
+                                    { return word.compare(0, term.size(), term) == 0; });
+    }
+    else if (first != words.end() && *first == term)
+    {
+        ++last;
+    }
+    return {(size_t)(first - words.begin()), (size_t)(last - words.begin())};
+}
+
+size_t DeckIndex::search(const Query &query, size_t limit, std::vector<Result> &results)
+{
+    ScopedPhase timing(Phase::SEARCH_DECK);
+    results.clear();
+    if (query.terms.empty() || slide_count == 0)
+        return 0;
+
+    // matched_terms counts the terms a slide has shown so far, so a slide only
+    // scores for a term once it had all the earlier ones. Every such slide is
+    // among the first term's candidates, which is all that needs resetting.
+    std::vector<uint32_t> candidates;
+    for (uint32_t term = 0; term < query.terms.size(); ++term)
+    {
+        auto range = word_range(query.terms[term], term + 1 == query.terms.size());
+        for (size_t id = range.first; id < range.second; ++id)
+        {
+            const std::vector<Posting> &list = postings[id];
+            float rarity = std::log(1.0f + (float)slide_count / (float)list.size());
+            for (const Posting &posting : list)
+            {
+                uint32_t &matched = matched_terms[posting.slide];
+                if (matched == term)
+                {
+                    matched = term + 1;
+                    if (term == 0)
+                        candidates.push_back(posting.slide);
+                }
+                if (matched == term + 1)
+                    scores[posting.slide] += posting.weight * rarity;
+            }
+        }
+    }
+
+    for (uint32_t slide : candidates)
+    {
+        if (matched_terms[slide] == query.terms.size())
+            results.push_back({(int)slide, scores[slide]});
+        matched_terms[slide] = 0;
+        scores[slide] = 0;
+    }
+
+    size_t total = results.size();
+    size_t count = std::min(limit, total);
+    std::partial_sort(results.begin(), results.begin() + count, results.end(),
+                      [](const Result &a, const Result &b)
+                      { return a.score != b.score ? a.score > b.score : a.slide < b.slide; });
+    results.resize(count);
+    return total;
+}
+
+void DeckIndex::match_ranges(const Query &query, std::string_view text,
+                             std::vector<std::pair<size_t, size_t>> &ranges)
+{
+    ranges.clear();
+    std::string word;
+    for_each_word(text, [&](size_t start, size_t end)
+                  {
+                      word.assign(text.data() + start, end - start);
+                      to_lower(word);
+                      for (size_t term = 0; term < query.terms.size(); ++term)
+                      {
+                          const std::string &pattern = query.terms[term];
+                          bool prefix = term + 1 == query.terms.size();
+                          if (word == pattern || (prefix && word.compare(0, pattern.size(), pattern) == 0))
+                          {
+                              ranges.emplace_back(start, end);
+                              break;
+                          }
+                      }
+                  });
+}
@@ -0,0 +1,331 @@
+#include "deck_loader.hh"
+#include "phase_profiler.hh"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <glob.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <thread>
+
+namespace
+{
+    int64_t modification_ns(const struct stat &info)
+    {
+        return (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+    }
+
+    bool is_markdown_name(const std::string &name)
+    {
+        auto ends_with = [&name](const std::string &suffix)
+        {
+            return name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+        };
+        return name[0] != '.' && (ends_with(".md") || ends_with(".markdown"));
+    }
+
+    // The path of an "<!-- include: path -->" line, else empty
+    std::string include_target(const std::string &line)
+    {
+        static const std::string opening = "<!-- include:";
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, opening.size(), opening) != 0)
+            return "";
+        size_t close = line.rfind("-->");
+        if (close == std::string::npos || close < start + opening.size())
+            return "";
+
+        std::string target = line.substr(start + opening.size(), close - start - opening.size());
+        size_t first = target.find_first_not_of(" \t");
+        size_t last = target.find_last_not_of(" \t");
+        return first == std::string::npos ? "" : target.substr(first, last - first + 1);
+    }
+
+    std::string directory_of(const std::string &path)
+    {
+        size_t slash = path.rfind('/');
+        if (slash == std::string::npos)
+            return ".";
+        return slash == 0 ? "/" : path.substr(0, slash);
+    }
+
+    void add_real_path(const std::string &path, std::vector<std::string> &files)
+    {
+        // One cache entry per file, however it was named
+        char *resolved = realpath(path.c_str(), nullptr);
+        files.push_back(resolved ? resolved : path);
+        free(resolved);
+    }
+}
+
+DeckLoader::DeckLoader(const MarkdownParser &markdown_parser) : parser(markdown_parser), parsed_count(0)
+{
+}
+
+size_t DeckLoader::get_parsed_count() const
+{
+    return parsed_count;
+}
+
+size_t DeckLoader::get_file_count() const
+{
+    return cache.size();
+}
+
+bool DeckLoader::expand(const std::string &path, const std::string &base_dir, std::vector<std::string> &files)
+{
+    if (path.empty())
+        return false;
+    std::string full = path[0] == '/' || base_dir.empty() ? path : base_dir + "/" + path;
+    std::vector<std::string> matches;
+    if (full.find_first_of("*?[") != std::string::npos)
+    {
+        glob_t found;
+        if (glob(full.c_str(), 0, nullptr, &found) == 0)
+        {
+            for (size_t i = 0; i < found.gl_pathc; ++i)
+            {
+                matches.push_back(found.gl_pathv[i]);
+            }
+        }
+        globfree(&found);
+    }
+    else
+    {
+        matches.push_back(full);
+    }
+
+    size_t before = files.size();
+    for (const auto &match : matches)
+    {
+        struct stat info;
+        if (stat(match.c_str(), &info) != 0)
+            continue;
+        if (!S_ISDIR(info.st_mode))
+        {
+            add_real_path(match, files);
+            continue;
+        }
+
+        std::vector<std::string> names;
+        if (DIR *dir = opendir(match.c_str()))
+        {
+            while (dirent *entry = readdir(dir))
+            {
+                if (is_markdown_name(entry->d_name))
+                    names.push_back(entry->d_name);
+            }
+            closedir(dir);
+        }
+        std::sort(names.begin(), names.end());
+        for (const auto &name : names)
+        {
+            add_real_path(match + "/" + name, files);
+        }
+    }
+    return files.size() > before;
+}
+
+void DeckLoader::parse_file(const std::string &path, ParsedFile &file) const
+{
+    // Taken before reading, so a write during the read shows up as a change next time
+    struct stat info;
+    std::ifstream in(path);
+    if (stat(path.c_str(), &info) != 0 || !in)
+    {
+        file.error = "Cannot read " + path + ": " + strerror(errno);
+        return;
+    }
+    file.mtime_ns = modification_ns(info);
+    file.size = info.st_size;
+
+    std::string line, content;
+    auto end_slide = [&]()
+    {
+        if (content.empty())
+            return;
+        file.slides.emplace_back();
+        parser.parse_slide(content, file.slides.back());
+        content.clear();
+    };
+
+    while (std::getline(in, line))
+    {
+        if (line == "---")
+        {
+            end_slide();
+            continue;
+        }
+
+        std::string target = include_target(line);
+        if (target.empty())
+        {
+            content += line + "\n";
+            continue;
+        }
+
+        end_slide();
+        file.includes.emplace_back(file.slides.size(), target);
+    }
+    end_slide();
+}
+
+void DeckLoader::parse_files(const std::vector<std::string> &paths,
+                             std::vector<std::shared_ptr<ParsedFile>> &files) const
+{
+    // Workers take the next unparsed file until none are left
+    files.assign(paths.size(), nullptr);
+    std::atomic<size_t> next(0);
+    auto work = [&]()
+    {
+        for (size_t i = next++; i < paths.size(); i = next++)
+        {
+            auto file = std::make_shared<ParsedFile>();
+            try
+            {
+                parse_file(paths[i], *file);
+            }
+            catch (const std::exception &e)
+            {
+                file->error = paths[i] + ": " + e.what();
+            }
+            files[i] = file;
+        }
+    };
+
+    size_t workers = std::min<size_t>(paths.size(), std::max(std::thread::hardware_concurrency(), 1u));
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers; ++i)
+    {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+bool DeckLoader::load(const std::vector<std::string> &paths, SlideCollection &slides, std::string &error)
+{
+    ScopedPhase timing(Phase::LOAD_SLIDES);
+    parsed_count = 0;
+
+    std::vector<std::string> roots;
+    for (const auto &path : paths)
+    {
+        if (!expand(path, "", roots))
+        {
+            error = "No Markdown file found at " + path;
+            return false;
+        }
+    }
+
+    // Breadth-first over the includes: the files of one level that are new
+    // or changed since they were cached are parsed together
+    std::map<std::string, std::shared_ptr<const ParsedFile>> deck_files;
+    std::map<std::string, std::vector<std::vector<std::string>>> deck_includes;
+    std::vector<std::string> level = roots;
+    while (!level.empty())
+    {
+        std::vector<std::string> stale;
+        for (const auto &path : level)
+        {
+            if (deck_files.count(path) || std::find(stale.begin(), stale.end(), path) != stale.end())
+                continue;
+
+            struct stat info;
+            auto cached = cache.find(path);
+            if (cached != cache.end() && stat(path.c_str(), &info) == 0 &&
+                cached->second->mtime_ns == modification_ns(info) && cached->second->size == info.st_size)
+                deck_files[path] = cached->second;
+            else
+                stale.push_back(path);
+        }
+
+        std::vector<std::shared_ptr<ParsedFile>> parsed;
+        parse_files(stale, parsed);
+        parsed_count += stale.size();
+        for (size_t i = 0; i < stale.size(); ++i)
+        {
+            if (!parsed[i]->error.empty())
+            {
+                error = parsed[i]->error;
+                return false;
+            }
+            deck_files[stale[i]] = parsed[i];
+        }
+
+        // Directories and patterns may match other files than when the
+        // including file was parsed, so its includes are expanded every time
+        std::vector<std::string> next_level;
+        for (const auto &path : level)
+        {
+            if (deck_includes.count(path))
+                continue;
+            auto &lists = deck_includes[path];
+            for (const auto &include : deck_files[path]->includes)
+            {
+                lists.emplace_back();
+                if (!expand(include.second, directory_of(path), lists.back()))
+                {
+                    error = path + ": include matches no file: " + include.second;
+                    return false;
+                }
+                for (const auto &included : lists.back())
+                {
+                    if (!deck_files.count(included))
+                        next_level.push_back(included);
+                }
+            }
+        }
+        level = std::move(next_level);
+    }
+
+    // Files no longer part of the deck are forgotten
+    cache = std::move(deck_files);
+    include_files = std::move(deck_includes);
+
+    SlideCollection assembled;
+    std::vector<std::string> open_files;
+    for (const auto &root : roots)
+    {
+        assemble(root, open_files, assembled);
+    }
+    slides = std::move(assembled);
+    return true;
+}
+
+void DeckLoader::assemble(const std::string &path, std::vector<std::string> &open_files,
+                          SlideCollection &slides) const
+{
+    // A file that includes itself, directly or through others, is not entered again
+    if (std::find(open_files.begin(), open_files.end(), path) != open_files.end())
+        return;
+    open_files.push_back(path);
+
+    const ParsedFile &file = *cache.at(path);
+    const auto &included_files = include_files.at(path);
+    size_t slide = 0;
+    for (size_t i = 0; i < file.includes.size(); ++i)
+    {
+        for (; slide < file.includes[i].first; ++slide)
+        {
+            slides.add_slide(file.slides[slide]);
+        }
+        for (const auto &included : included_files[i])
+        {
+            assemble(included, open_files, slides);
+        }
+    }
+    for (; slide < file.slides.size(); ++slide)
+    {
+        slides.add_slide(file.slides[slide]);
+    }
+
+    open_files.pop_back();
+}
@@ -0,0 +1,168 @@
+#include "event_loop.hh"
+#include <cerrno>
+#include <stdexcept>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+EventLoop::EventLoop() : stopped(false), depth(0), modals(0)
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0)
+    {
+        throw std::runtime_error("Failed to create epoll instance");
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    close(epoll_fd);
+}
+
+void EventLoop::add_fd(int fd, Handler handler, uint32_t events)
+{
+    epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        throw std::runtime_error("Failed to watch file descriptor");
+    }
+    handlers[fd] = std::make_shared<Handler>(std::move(handler));
+}
+
+void EventLoop::modify_fd(int fd, uint32_t events)
+{
+    epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+}
+
+void EventLoop::remove_fd(int fd)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    handlers.erase(fd);
+}
+
+int EventLoop::add_timer(int initial_ms, int interval_ms, std::function<void()> handler)
+{
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0)
+    {
+        throw std::runtime_error("Failed to create timer");
+    }
+
+    // A zero it_value would disarm the timer
+    if (initial_ms <= 0)
+        initial_ms = 1;
+
+    itimerspec spec = {};
+    spec.it_value.tv_sec = initial_ms / 1000;
+    spec.it_value.tv_nsec = (initial_ms % 1000) * 1000000L;
+    spec.it_interval.tv_sec = interval_ms / 1000;
+    spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    timerfd_settime(timer_fd, 0, &spec, nullptr);
+
+    add_fd(timer_fd, [timer_fd, handler](uint32_t)
+           {
+               uint64_t expirations;
+               if (read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+               {
+                   handler();
+               }
+           });
+    return timer_fd;
+}
+
+void EventLoop::remove_timer(int timer_fd)
+{
+    remove_fd(timer_fd);
+    close(timer_fd);
+}
+
+void EventLoop::set_interrupt_handler(std::function<void()> handler)
+{
+    interrupt_handler = std::move(handler);
+}
+
+void EventLoop::run_once(int timeout_ms)
+{
+    epoll_event events[16];
+    int ready = epoll_wait(epoll_fd, events, 16, timeout_ms);
+    if (ready < 0)
+    {
+        if (errno == EINTR && interrupt_handler)
+        {
+            interrupt_handler();
+        }
+        return;
+    }
+
+    for (int i = 0; i < ready && !stopped; ++i)
+    {
+        // A handler may remove other fds (or itself) while we dispatch
+        auto it = handlers.find(events[i].data.fd);
+        if (it == handlers.end())
+            continue;
+        std::shared_ptr<Handler> handler = it->second;
+        (*handler)(events[i].events);
+    }
+}
+
+void EventLoop::run()
+{
+    depth++;
+    stopped = false;
+    while (!stopped)
+    {
+        run_once(-1);
+    }
+    if (--depth > 0)
+        stopped = false;
+}
+
+void EventLoop::stop()
+{
+    stopped = true;
+}
+
+bool EventLoop::is_stopped() const
+{
+    return stopped;
+}
+
+void EventLoop::run_modal(std::function<void()> on_input)
+{
+    // The handlers of the view below are set aside, not removed: one of
+    // them is usually what opened this view
+    std::shared_ptr<Handler> previous_input;
+    auto found = handlers.find(STDIN_FILENO);
+    if (found != handlers.end())
+    {
+        previous_input = found->second;
+        found->second = std::make_shared<Handler>([on_input](uint32_t)
+                                                  { on_input(); });
+    }
+    else
+    {
+        add_fd(STDIN_FILENO, [on_input](uint32_t)
+               { on_input(); });
+    }
+    std::function<void()> previous_interrupt = std::move(interrupt_handler);
+    interrupt_handler = on_input;
+
+    modals++;
+    run();
+    modals--;
+
+    if (previous_input)
+        handlers[STDIN_FILENO] = std::move(previous_input);
+    else
+        remove_fd(STDIN_FILENO);
+    interrupt_handler = std::move(previous_interrupt);
+}
+
+bool EventLoop::in_modal() const
+{
+    return modals > 0;
+}
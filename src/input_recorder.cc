@@ -0,0 +1,284 @@
+#include "input_recorder.hh"
+#include "terminal_output.hh"
+#include <ncurses.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <poll.h>
+#include <unistd.h>
+
+namespace
+{
+    const char *FILE_HEADER = "mdslides-input 1\n";
+    const int OUT_OF_KEYS_MS = 100;
+
+    void put_varint(std::string &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out += (char)(0x80 | (value & 0x7f));
+            value >>= 7;
+        }
+        out += (char)value;
+    }
+
+    bool get_varint(const std::string &data, size_t &position, uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; position < data.size() && shift < 64; shift += 7)
+        {
+            uint8_t byte = data[position++];
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+}
+
+InputRecorder::InputRecorder()
+    : recording(false), replaying(false), start_lines(0), start_cols(0), speed(1.0), next_key(0),
+      key_just_read(false), release_fd(-1), stopping(false)
+{
+}
+
+InputRecorder &InputRecorder::instance()
+{
+    static InputRecorder recorder;
+    return recorder;
+}
+
+bool InputRecorder::record(const std::string &name, std::string &error)
+{
+    // Fail early rather than after a whole talk
+    FILE *file = fopen(name.c_str(), "wb");
+    if (!file)
+    {
+        error = "Cannot write input recording: " + name;
+        return false;
+    }
+    fclose(file);
+
+    filename = name;
+    recording = true;
+    return true;
+}
+
+bool InputRecorder::replay(const std::string &name, double replay_speed, std::string &error)
+{
+    std::ifstream in(name, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (!in)
+    {
+        error = "Cannot open input recording: " + name;
+        return false;
+    }
+
+    size_t header_length = strlen(FILE_HEADER);
+    size_t position = header_length;
+    uint64_t lines, cols;
+    if (data.compare(0, header_length, FILE_HEADER) != 0 || !get_varint(data, position, lines) ||
+        !get_varint(data, position, cols))
+    {
+        error = name + ": not an input recording";
+        return false;
+    }
+    start_lines = (int)lines;
+    start_cols = (int)cols;
+
+    keys.clear();
+    while (position < data.size())
+    {
+        uint64_t delta_us, key, key_lines = 0, key_cols = 0;
+        if (!get_varint(data, position, delta_us) || !get_varint(data, position, key) ||
+            (key == KEY_RESIZE && (!get_varint(data, position, key_lines) || !get_varint(data, position, key_cols))))
+        {
+            error = name + ": truncated or corrupt record";
+            return false;
+        }
+        keys.push_back({delta_us, (int)key, (int)key_lines, (int)key_cols});
+    }
+
+    // The keys arrive on stdin; the keyboard is no longer read
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0 || dup2(fds[0], STDIN_FILENO) < 0)
+    {
+        error = std::string("Cannot replace stdin: ") + strerror(errno);
+        return false;
+    }
+    ::close(fds[0]);
+    release_fd = fds[1];
+    speed = replay_speed;
+    next_key = 0;
+    replaying = true;
+    return true;
+}
+
+void InputRecorder::start()
+{
+    origin = last_key = std::chrono::steady_clock::now();
+    if (recording)
+    {
+        encoded = FILE_HEADER;
+        put_varint(encoded, LINES);
+        put_varint(encoded, COLS);
+    }
+    if (!replaying)
+        return;
+
+    // Laid out for the recorded screen, as it was
+    if (start_lines > 0 && start_cols > 0 && (start_lines != LINES || start_cols != COLS))
+        resize_term(start_lines, start_cols);
+
+    if (speed == 0)
+    {
+        release_one();
+        return;
+    }
+    // Signals (SIGWINCH, SIGUSR1, ...) stay with the UI thread
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &previous);
+    releaser = std::thread([this]()
+                           { release_keys(); });
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+int InputRecorder::read_key()
+{
+    if (!replaying)
+    {
+        // SIGWINCH is caught by TerminalOutput, as ncurses cannot ask the terminal
+        int ch, lines, cols;
+        if (TerminalOutput::take_resize(lines, cols))
+        {
+            resize_term(lines, cols);
+            ch = KEY_RESIZE;
+        }
+        else
+            ch = getch();
+        if (recording && ch != ERR)
+        {
+            auto now = std::chrono::steady_clock::now();
+            put_varint(encoded, std::chrono::duration_cast<std::chrono::microseconds>(now - last_key).count());
+            put_varint(encoded, ch);
+            if (ch == KEY_RESIZE)
+            {
+                put_varint(encoded, LINES);
+                put_varint(encoded, COLS);
+            }
+            last_key = now;
+        }
+        return ch;
+    }
+
+    // Each byte on stdin stands for the next recorded key
+    int delay = wgetdelay(stdscr);
+    if (delay == 0 && key_just_read)
+    {
+        // At speed 0 the next key is always waiting; one key per wakeup
+        // keeps the keys from being taken as one burst
+        key_just_read = false;
+        return ERR;
+    }
+    char byte;
+    if (read(STDIN_FILENO, &byte, 1) != 1)
+    {
+        if (delay == 0)
+            return ERR;
+
+        pollfd pending = {STDIN_FILENO, POLLIN, 0};
+        while (poll(&pending, 1, delay) < 0 && errno == EINTR)
+        {
+        }
+        if (read(STDIN_FILENO, &byte, 1) != 1)
+            return ERR;
+    }
+    if (speed == 0)
+    {
+        release_one();
+        key_just_read = true;
+    }
+    return next_replayed_key();
+}
+
+int InputRecorder::next_replayed_key()
+{
+    size_t index = next_key++;
+    if (index >= keys.size())
+    {
+        // A recording cut short: ESC closes whatever is open, q quits
+        return (index - keys.size()) % 2 == 0 ? 27 : 'q';
+    }
+
+    const Key &key = keys[index];
+    if (index + 1 == keys.size())
+        last_key = std::chrono::steady_clock::now();
+    if (key.key == KEY_RESIZE)
+        resize_term(key.lines, key.cols);
+    return key.key;
+}
+
+void InputRecorder::release_one()
+{
+    char byte = 0;
+    ssize_t ignored = write(release_fd, &byte, 1);
+    (void)ignored;
+}
+
+void InputRecorder::release_keys()
+{
+    std::unique_lock<std::mutex> lock(stop_mutex);
+    auto due = origin;
+    for (size_t i = 0;; ++i)
+    {
+        if (i < keys.size())
+            due += std::chrono::microseconds((int64_t)(keys[i].delta_us / speed));
+        else
+            due += std::chrono::milliseconds(OUT_OF_KEYS_MS);
+        if (stop_condition.wait_until(lock, due, [this]()
+                                      { return stopping; }))
+            return;
+        release_one();
+    }
+}
+
+bool InputRecorder::close()
+{
+    if (replaying)
+    {
+        replaying = false;
+        if (releaser.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(stop_mutex);
+                stopping = true;
+            }
+            stop_condition.notify_all();
+            releaser.join();
+        }
+        ::close(release_fd);
+        release_fd = -1;
+
+        // Up to the last recorded key, or to the end when it quit earlier
+        size_t replayed = std::min(next_key, keys.size());
+        auto end = replayed == keys.size() && replayed > 0 ? last_key : std::chrono::steady_clock::now();
+        fprintf(stderr, "Replayed %zu of %zu keys in %.3f s\n", replayed, keys.size(),
+                std::chrono::duration<double>(end - origin).count());
+        return true;
+    }
+
+    if (!recording)
+        return true;
+    recording = false;
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file)
+        return false;
+    bool written = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    return fclose(file) == 0 && written;
+}
@@ -1,36 +1,216 @@
 #include "slide_renderer.hh"
 #include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static void print_usage(const char *program)
+{
+    printf("Usage: %s [options] <markdown_file|directory|pattern>...\n", program);
+    printf("\nOptions:\n");
+    printf("  --stats                Print terminal output statistics on exit\n");
+    printf("  --latency-json <file>  Write per-phase latency percentiles on exit and on SIGUSR1\n");
+    printf("  --trace <file>         Write a Chrome Trace Event timeline of input and rendering\n");
+    printf("  --themes <file>        Load additional themes (256-colour or #rrggbb) from a palette file\n");
+    printf("  --spill-output         Keep all command output in a temporary file, not just the last 10000 lines\n");
+    printf("  --no-pty               Run shell commands on a pipe instead of a pseudo-terminal\n");
+    printf("  --shell-session        Run the deck's commands in one shell, keeping cd and variables between them\n");
+    printf("  --record-output        Record shell command output with timing to <first path>.output\n");
+    printf("  --replay-output        Replay recorded output instead of running commands\n");
+    printf("  --record-input <file>  Record every key, with its timing, to <file>\n");
+    printf("  --replay-input <file>  Replay the keys recorded in <file> instead of reading the keyboard\n");
+    printf("  --replay-speed <x>     Replay output and keys x times faster (default 1, 0 = as fast as possible)\n");
+    printf("  --export <format>      Write every slide to stdout as ansi, txt or html, without a terminal\n");
+    printf("  --width <columns>      Width of exported slides (default 80)\n");
+    printf("  --presenter <socket>   Presenter view with notes, next slide and timer; drives a follower\n");
+    printf("  --follow <socket>      Show the slides and command output of the presenter at <socket>\n");
+    printf("\nExample markdown format:\n");
+    printf("# Title Slide\n");
+    printf("This is the content\n");
+    printf("---\n");
+    printf("## Second Slide\n");
+    printf("- Bullet point 1\n");
+    printf("- Bullet point 2\n");
+    printf("---\n");
+    printf("### Code Example\n");
+    printf("```cpp\n");
+    printf("int main() {\n");
+    printf("    return 0;\n");
+    printf("}\n");
+    printf("```\n");
+    printf("---\n");
+    printf("### Shell Command Demo\n");
+    printf("```$ls -la\n");
+    printf("```\n");
+    printf("```$date\n");
+    printf("```\n");
+    printf("\nSeveral files, directories (their *.md files) or patterns form one deck;\n");
+    printf("a line <!-- include: chapter.md --> inserts another file's slides there.\n");
+    printf("Other HTML comments are speaker notes, shown in the presenter view.\n");
+}
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
-    {
-        printf("Usage: %s <markdown_file>\n", argv[0]);
-        printf("\nExample markdown format:\n");
-        printf("# Title Slide\n");
-        printf("This is the content\n");
-        printf("---\n");
-        printf("## Second Slide\n");
-        printf("- Bullet point 1\n");
-        printf("- Bullet point 2\n");
-        printf("---\n");
-        printf("### Code Example\n");
-        printf("```cpp\n");
-        printf("int main() {\n");
-        printf("    return 0;\n");
-        printf("}\n");
-        printf("```\n");
-        printf("---\n");
-        printf("### Shell Command Demo\n");
-        printf("```$ls -la\n");
-        printf("```\n");
-        printf("```$date\n");
-        printf("```\n");
+    std::vector<std::string> paths;
+    bool show_stats = false;
+    std::string latency_json;
+    std::string trace_file;
+    std::string themes_file;
+    bool spill_output = false;
+    bool use_pty = true;
+    bool shell_session = false;
+    bool record_output = false;
+    bool replay_output = false;
+    double replay_speed = 1.0;
+    std::string record_input;
+    std::string replay_input;
+    std::string export_format;
+    int export_width = 80;
+    std::string presenter_socket;
+    std::string follow_socket;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--stats")
+        {
+            show_stats = true;
+        }
+        else if (arg == "--latency-json" && i + 1 < argc)
+        {
+            latency_json = argv[++i];
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            trace_file = argv[++i];
+        }
+        else if (arg == "--themes" && i + 1 < argc)
+        {
+            themes_file = argv[++i];
+        }
+        else if (arg == "--spill-output")
+        {
+            spill_output = true;
+        }
+        else if (arg == "--no-pty")
+        {
+            use_pty = false;
+        }
+        else if (arg == "--shell-session")
+        {
+            shell_session = true;
+        }
+        else if (arg == "--record-output")
+        {
+            record_output = true;
+        }
+        else if (arg == "--replay-output")
+        {
+            replay_output = true;
+        }
+        else if (arg == "--record-input" && i + 1 < argc)
+        {
+            record_input = argv[++i];
+        }
+        else if (arg == "--replay-input" && i + 1 < argc)
+        {
+            replay_input = argv[++i];
+        }
+        else if (arg == "--replay-speed" && i + 1 < argc)
+        {
+            replay_speed = std::atof(argv[++i]);
+        }
+        else if (arg == "--export" && i + 1 < argc)
+        {
+            export_format = argv[++i];
+        }
+        else if (arg == "--width" && i + 1 < argc)
+        {
+            export_width = std::atoi(argv[++i]);
+        }
+        else if (arg == "--presenter" && i + 1 < argc)
+        {
+            presenter_socket = argv[++i];
+        }
+        else if (arg == "--follow" && i + 1 < argc)
+        {
+            follow_socket = argv[++i];
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            print_usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            paths.push_back(arg);
+        }
+    }
+
+    if (paths.empty() || (record_output && replay_output) || replay_speed < 0 ||
+        (!record_input.empty() && !replay_input.empty()) || export_width < 1 ||
+        (!presenter_socket.empty() && !follow_socket.empty()))
+    {
+        print_usage(argv[0]);
         return 1;
     }
 
     MarkdownSlideRenderer renderer;
-    renderer.load_slides(argv[1]);
+    renderer.set_stats_summary(show_stats);
+    renderer.set_latency_json(latency_json);
+    renderer.set_output_spill(spill_output);
+    renderer.set_use_pty(use_pty);
+    renderer.set_shell_session(shell_session);
+    if (!trace_file.empty() && !renderer.set_trace_file(trace_file))
+    {
+        fprintf(stderr, "Cannot write trace file: %s\n", trace_file.c_str());
+        return 1;
+    }
+    std::string error;
+    if (!themes_file.empty() && !renderer.load_themes(themes_file, error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    // Recordings sit next to the first file or directory
+    std::string first_path = paths.front();
+    while (first_path.size() > 1 && first_path.back() == '/')
+        first_path.pop_back();
+    std::string sidecar = CommandRecorder::sidecar_path(first_path);
+    if ((record_output && !renderer.record_output(sidecar, error)) ||
+        (replay_output && !renderer.replay_output(sidecar, replay_speed, error)))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if ((!record_input.empty() && !renderer.record_input(record_input, error)) ||
+        (!replay_input.empty() && !renderer.replay_input(replay_input, replay_speed, error)))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (!renderer.load_slides(paths, error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (!export_format.empty())
+    {
+        if (!renderer.export_slides(export_format, export_width, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        return 0;
+    }
+    if (!presenter_socket.empty() && !renderer.start_presenter_view(presenter_socket, error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (!follow_socket.empty())
+        renderer.follow_presenter(follow_socket);
     renderer.run();
 
     return 0;
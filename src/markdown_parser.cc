@@ -1,5 +1,5 @@
 #include "markdown_parser.hh"
-#include <ncurses.h>
+#include "phase_profiler.hh"
 #include <fstream>
 #include <sstream>
 #include <regex>
@@ -57,6 +57,10 @@ private:
             processList(node);
             break;
 
+        case CMARK_NODE_HTML_BLOCK:
+            processHtmlBlock(node);
+            break;
+
         default:
             // For other node types, process recursively
             cmark_node *child;
@@ -86,8 +90,7 @@ private:
         {
         case 1:
             element.color_pair = 1;
-            element.type = ElementType::HEADER1;
-            element.x = std::max((COLS - (int)content.length()) / 2, 2);
+            element.type = ElementType::HEADER1; // centered by SlideCollection::ensure_layout
             break;
         case 2:
             element.color_pair = 2;
@@ -127,6 +130,30 @@ private:
         }
     }
 
+    // Leading !flag words after the $ set options and are not part of the command
+    void parseShellFlags(std::string &command, SlideElement &element)
+    {
+        while (!command.empty() && command[0] == '!')
+        {
+            size_t end = command.find(' ');
+            std::string flag = command.substr(1, end == std::string::npos ? std::string::npos : end - 1);
+            if (flag == "prefetch")
+                element.prefetch = true;
+            else if (flag == "inline")
+                element.inline_output = true;
+            else if (flag.compare(0, 7, "inline=") == 0 && atoi(flag.c_str() + 7) > 0)
+            {
+                element.inline_output = true;
+                element.max_output_lines = atoi(flag.c_str() + 7);
+            }
+            else
+                break; // not one of ours; leave it to the shell
+
+            size_t next = end == std::string::npos ? end : command.find_first_not_of(' ', end);
+            command = next == std::string::npos ? "" : command.substr(next);
+        }
+    }
+
     void processCodeBlock(cmark_node *node)
     {
         const char *info = cmark_node_get_fence_info(node);
@@ -138,6 +165,7 @@ private:
             std::string command = std::string(info + 1); // Skip the $
 
             SlideElement element;
+            parseShellFlags(command, element);
             element.y = current_y++;
             element.x = 4;
             element.content = "    $ " + command;
@@ -146,6 +174,22 @@ private:
             element.shell_command = command;
             element.animation = AnimationType::TYPEWRITER;
             elements.push_back(element);
+
+            if (element.inline_output)
+            {
+                // Rows reserved under the fence for the command's output
+                SlideElement output;
+                output.y = current_y;
+                output.x = 6;
+                output.content = "(ENTER runs the command here)";
+                output.color_pair = 6;
+                output.type = ElementType::SHELL_OUTPUT;
+                output.shell_command = command;
+                output.animation = AnimationType::NONE;
+                output.max_output_lines = element.max_output_lines;
+                elements.push_back(output);
+                current_y += output.max_output_lines;
+            }
         }
         else
         {
@@ -191,6 +235,34 @@ private:
         }
     }
 
+    void processHtmlBlock(cmark_node *node)
+    {
+        // HTML comments are speaker notes; they take no room on the slide
+        const char *literal = cmark_node_get_literal(node);
+        std::string html = literal ? literal : "";
+        size_t open = 0;
+        while ((open = html.find("<!--", open)) != std::string::npos)
+        {
+            size_t close = html.find("-->", open + 4);
+            std::string text = html.substr(open + 4, close == std::string::npos ? std::string::npos : close - open - 4);
+            open = close == std::string::npos ? html.size() : close + 3;
+
+            size_t first = text.find_first_not_of(" \t\n");
+            if (first == std::string::npos)
+                continue;
+            size_t last = text.find_last_not_of(" \t\n");
+
+            SlideElement element;
+            element.y = current_y;
+            element.x = 2;
+            element.content = text.substr(first, last - first + 1);
+            element.color_pair = 3;
+            element.type = ElementType::NOTE;
+            element.animation = AnimationType::NONE;
+            elements.push_back(element);
+        }
+    }
+
     void extractTextWithFormatting(cmark_node *node, std::string &content, bool &is_bold)
     {
         cmark_node_type type = cmark_node_get_type(node);
@@ -338,35 +410,7 @@ void MarkdownParser::set_utf8_support(bool enabled)
     utf8_supported = enabled;
 }
 
-void MarkdownParser::load_slides(const std::string &filename, SlideCollection &slides)
-{
-    slides.clear();
-
-    std::ifstream file(filename);
-    std::string line, slide_content;
-
-    while (std::getline(file, line))
-    {
-        if (line == "---")
-        {
-            if (!slide_content.empty())
-            {
-                parse_slide(slide_content, slides);
-                slide_content.clear();
-            }
-        }
-        else
-        {
-            slide_content += line + "\n";
-        }
-    }
-    if (!slide_content.empty())
-    {
-        parse_slide(slide_content, slides);
-    }
-}
-
-void MarkdownParser::parse_slide_with_cmark(const std::string &content, SlideCollection &slides)
+void MarkdownParser::parse_slide_with_cmark(const std::string &content, std::vector<SlideElement> &elements) const
 {
     // Create parser with basic options (no extensions)
     cmark_parser *parser = cmark_parser_new(CMARK_OPT_DEFAULT);
@@ -377,8 +421,12 @@ void MarkdownParser::parse_slide_with_cmark(const std::string &content, SlideCol
     }
 
     // Parse markdown
-    cmark_parser_feed(parser, content.c_str(), content.length());
-    cmark_node *document = cmark_parser_finish(parser);
+    cmark_node *document;
+    {
+        ScopedPhase timing(Phase::PARSE_SLIDE);
+        cmark_parser_feed(parser, content.c_str(), content.length());
+        document = cmark_parser_finish(parser);
+    }
 
     if (!document)
     {
@@ -387,20 +435,18 @@ void MarkdownParser::parse_slide_with_cmark(const std::string &content, SlideCol
     }
 
     // Convert to slide elements using the fixed parser
-    std::vector<SlideElement> elements;
-    CMarkSlideParser slide_parser(elements, utf8_supported);
-    slide_parser.parseDocument(document);
+    {
+        ScopedPhase timing(Phase::LAYOUT);
+        CMarkSlideParser slide_parser(elements, utf8_supported);
+        slide_parser.parseDocument(document);
+    }
 
     // Cleanup
     cmark_node_free(document);
     cmark_parser_free(parser);
-
-    // Add to slides
-    slides.add_slide(elements);
 }
 
-// Updated parse_slide method
-void MarkdownParser::parse_slide(const std::string &content, SlideCollection &slides)
+void MarkdownParser::parse_slide(const std::string &content, std::vector<SlideElement> &elements) const
 {
-    parse_slide_with_cmark(content, slides);
+    parse_slide_with_cmark(content, elements);
 }
@@ -1,4 +1,6 @@
 #include "ncurses_renderer.hh"
+#include "terminal_output.hh"
+#include "input_recorder.hh"
 #include <ncurses.h>
 #include <algorithm>
 #include <thread>
@@ -6,8 +8,10 @@
 #include <locale.h>
 #include <cstdlib>
 #include <cstring>
+#include <poll.h>
+#include <unistd.h>
 
-NCursesRenderer::NCursesRenderer() : utf8_supported(false)
+NCursesRenderer::NCursesRenderer() : frame_depth(0), echo_input(false), utf8_supported(false)
 {
     utf8_supported = detect_utf8_support();
     load_char_replacements();
@@ -21,10 +25,23 @@ NCursesRenderer::~NCursesRenderer()
 void NCursesRenderer::initialize()
 {
     setlocale(LC_ALL, "");
-    initscr();
+
+    // ncurses draws through TerminalOutput, which counts what reaches the terminal
+    FILE *output = TerminalOutput::open();
+    if (!newterm(nullptr, output ? output : stdout, stdin))
+    {
+        TerminalOutput::close();
+        fprintf(stderr, "Error opening terminal: %s.\n", getenv("TERM") ? getenv("TERM") : "unknown");
+        exit(EXIT_FAILURE);
+    }
+    int lines, cols;
+    if (output && TerminalOutput::get_size(lines, cols))
+        resize_term(lines, cols);
     noecho();
     cbreak();
     keypad(stdscr, TRUE);
+    // ESC stops commands and closes popups; don't wait a full second for it
+    set_escdelay(100);
     curs_set(0);
 
     if (has_colors())
@@ -32,24 +49,49 @@ void NCursesRenderer::initialize()
         start_color();
     }
 
-    theme_manager.setup_theme(Theme::DARK);
+    theme_manager.setup_theme(static_cast<int>(Theme::DARK));
 }
 
 void NCursesRenderer::cleanup()
 {
+    // ncurses keeps its stream after endwin(), so it must not draw once the
+    // stream is closed
+    if (!stdscr || isendwin())
+        return;
     endwin();
+    TerminalOutput::close();
 }
 
 void NCursesRenderer::render_slide(const std::vector<SlideElement> &elements, bool animated)
 {
     clear_with_background(2, LINES - 3); // clear area between header and footer
 
+    // Elements below the content area would overwrite the progress bar and footer.
+    // Inline output that exists is drawn by its owner; until then a placeholder shows.
+    // Speaker notes are for the presenter view only.
+    int content_end = LINES - 4;
+    auto drawn_here = [content_end](const SlideElement &element)
+    {
+        return !(element.type == ElementType::SHELL_OUTPUT && element.executed) &&
+               element.type != ElementType::NOTE && element.y < content_end;
+    };
+
     if (animated)
     {
+        // A pending key finishes the animation at once so the next action is not delayed
+        bool skip_animation = false;
         for (const auto &element : elements)
         {
-            if (element.type != ElementType::SHELL_OUTPUT)
+            if (drawn_here(element))
             {
+                if (!skip_animation && check_for_input_during_animation())
+                    skip_animation = true;
+
+                if (skip_animation)
+                {
+                    render_element_instant(element);
+                    continue;
+                }
                 std::this_thread::sleep_for(std::chrono::milliseconds(element.delay_ms));
                 render_element_animated(element);
             }
@@ -59,14 +101,14 @@ void NCursesRenderer::render_slide(const std::vector<SlideElement> &elements, bo
     {
         for (const auto &element : elements)
         {
-            if (element.type != ElementType::SHELL_OUTPUT)
+            if (drawn_here(element))
             {
                 render_element_instant(element);
             }
         }
     }
 
-    refresh();
+    present();
 }
 
 void NCursesRenderer::clear_screen()
@@ -77,19 +119,32 @@ void NCursesRenderer::clear_screen()
 void NCursesRenderer::draw_header(int current_slide, int total_slides, const std::string &theme_name,
                                   bool show_timer, int minutes, int seconds, bool utf8_mode)
 {
+    check_chrome_size();
+
+    bool full = !chrome.header_valid || chrome.slide != current_slide ||
+                chrome.total_slides != total_slides || chrome.theme_name != theme_name ||
+                chrome.utf8_mode != utf8_mode;
+    bool timer_changed = full || chrome.show_timer != show_timer ||
+                         (show_timer && (chrome.minutes != minutes || chrome.seconds != seconds));
+    if (!timer_changed)
+        return;
+
     attron(COLOR_PAIR(1) | A_BOLD);
-    mvprintw(0, 2, "Slide %d/%d", current_slide + 1, total_slides);
+    if (full)
+    {
+        std::string counter = "Slide " + std::to_string(current_slide + 1) + "/" + std::to_string(total_slides);
+        mvprintw(0, 2, "%-15s", counter.c_str());
 
-    // Clear and show UTF-8 mode indicator
-    std::string mode_indicator = utf8_mode ? "UTF-8" : "ASCII";
-    mvprintw(0, COLS - 25, "Mode: %-6s", mode_indicator.c_str());
+        // Show UTF-8 mode indicator
+        std::string mode_indicator = utf8_mode ? "UTF-8" : "ASCII";
+        mvprintw(0, COLS - 28, "Mode: %-6s", mode_indicator.c_str());
 
-    // Clear and show theme name with proper spacing
-    mvprintw(0, COLS - 15, "Theme: %-8s", theme_name.c_str());
+        // Show theme name with proper spacing
+        mvprintw(0, COLS - 15, "Theme: %-8.8s", theme_name.c_str());
+    }
 
     if (show_timer)
     {
-        // Clear timer area and show time
         mvprintw(0, COLS - 45, "Time: %02d:%02d    ", minutes, seconds);
     }
     else
@@ -97,16 +152,31 @@ void NCursesRenderer::draw_header(int current_slide, int total_slides, const std
         // Clear timer area when timer is off
         mvprintw(0, COLS - 45, "             ");
     }
-
     attroff(COLOR_PAIR(1) | A_BOLD);
 
-    attron(COLOR_PAIR(4));
-    mvhline(1, 0, '-', COLS);
-    attroff(COLOR_PAIR(4));
+    if (full)
+    {
+        attron(COLOR_PAIR(4));
+        mvhline(1, 0, '-', COLS);
+        attroff(COLOR_PAIR(4));
+    }
+
+    chrome.header_valid = true;
+    chrome.slide = current_slide;
+    chrome.total_slides = total_slides;
+    chrome.theme_name = theme_name;
+    chrome.utf8_mode = utf8_mode;
+    chrome.show_timer = show_timer;
+    chrome.minutes = minutes;
+    chrome.seconds = seconds;
 }
 
 void NCursesRenderer::draw_footer()
 {
+    check_chrome_size();
+    if (chrome.footer_valid)
+        return;
+
     attron(COLOR_PAIR(4));
     mvhline(LINES - 2, 0, '-', COLS);
     attroff(COLOR_PAIR(4));
@@ -114,6 +184,8 @@ void NCursesRenderer::draw_footer()
     attron(COLOR_PAIR(3));
     mvprintw(LINES - 1, 2, "Controls: <-/-> Navigate | ENTER Execute | u/d Scroll | 't' Theme | 'h' Help | 'q' Quit");
     attroff(COLOR_PAIR(3));
+
+    chrome.footer_valid = true;
 }
 
 void NCursesRenderer::draw_progress_bar(int current_slide, int total_slides)
@@ -121,19 +193,48 @@ void NCursesRenderer::draw_progress_bar(int current_slide, int total_slides)
     if (total_slides == 0)
         return;
 
-    int progress_width = (current_slide * (COLS - 4)) / total_slides;
+    check_chrome_size();
 
-    attron(COLOR_PAIR(4));
-    mvprintw(LINES - 3, 2, "[");
-    mvprintw(LINES - 3, COLS - 3, "]");
+    int inner_width = std::max(COLS - 6, 0); // between the brackets
+    int progress_width = (current_slide * inner_width) / total_slides;
+    if (chrome.progress_valid && chrome.progress_width == progress_width)
+        return;
 
-    attron(COLOR_PAIR(1) | A_BOLD);
-    for (int i = 0; i < progress_width; ++i)
+    if (!chrome.progress_valid)
     {
-        mvprintw(LINES - 3, 3 + i, "#");
+        attron(COLOR_PAIR(4));
+        mvprintw(LINES - 3, 2, "[");
+        mvprintw(LINES - 3, COLS - 3, "]");
+        attroff(COLOR_PAIR(4));
     }
+
+    // Filled and empty part as one run each
+    attron(COLOR_PAIR(1) | A_BOLD);
+    mvhline(LINES - 3, 3, '#', progress_width);
     attroff(COLOR_PAIR(1) | A_BOLD);
-    attroff(COLOR_PAIR(4));
+    attron(COLOR_PAIR(0));
+    mvhline(LINES - 3, 3 + progress_width, ' ', inner_width - progress_width);
+    attroff(COLOR_PAIR(0));
+
+    chrome.progress_valid = true;
+    chrome.progress_width = progress_width;
+}
+
+void NCursesRenderer::invalidate_chrome()
+{
+    chrome.header_valid = false;
+    chrome.footer_valid = false;
+    chrome.progress_valid = false;
+}
+
+void NCursesRenderer::check_chrome_size()
+{
+    if (chrome.screen_width != COLS || chrome.screen_height != LINES)
+    {
+        invalidate_chrome();
+        chrome.screen_width = COLS;
+        chrome.screen_height = LINES;
+    }
 }
 
 void NCursesRenderer::show_help(bool utf8_supported)
@@ -147,9 +248,12 @@ void NCursesRenderer::show_help(bool utf8_supported)
         "  -> / Space / l    Next slide",
         "  <- / Backspace / h Previous slide",
         "  g                Go to specific slide",
+        "  /                Search all slides",
+        "  o                Overview of all slides",
         "  Home / 0         First slide",
         "  End / $          Last slide",
         "  ENTER            Execute shell commands",
+        "  A                Run all shell commands side by side",
         "  u / d            Scroll shell output up/down",
         "",
         "Display:",
@@ -157,6 +261,7 @@ void NCursesRenderer::show_help(bool utf8_supported)
         "  a                Toggle animations",
         "  T                Toggle timer",
         "  r                Refresh/redraw",
+        "  R                Reload changed deck files",
         "",
         "Other:",
         "  h                Show this help",
@@ -185,7 +290,7 @@ void NCursesRenderer::show_help(bool utf8_supported)
     mvprintw(LINES - 2, 2, "Press any key to continue...");
     attroff(COLOR_PAIR(4) | A_BOLD);
 
-    refresh();
+    present();
 }
 
 void NCursesRenderer::show_message(const std::string &message, int y)
@@ -196,18 +301,92 @@ void NCursesRenderer::show_message(const std::string &message, int y)
     attron(COLOR_PAIR(4) | A_BOLD);
     mvprintw(y, 2, "%s", message.c_str());
     attroff(COLOR_PAIR(4) | A_BOLD);
-    refresh();
+    present();
 }
 
 void NCursesRenderer::clear_message_area()
 {
     mvprintw(LINES - 4, 2, "%*s", COLS - 4, "");
-    refresh();
+    present();
+}
+
+void NCursesRenderer::draw_stats_overlay(const std::string &text)
+{
+    // Free header space between the slide counter and the timer
+    int start_x = 18;
+    int width = COLS - 45 - start_x - 1;
+    if (width <= 0)
+        return;
+
+    attron(COLOR_PAIR(4));
+    mvprintw(0, start_x, "%-*.*s", width, width, text.c_str());
+    attroff(COLOR_PAIR(4));
+}
+
+void NCursesRenderer::draw_notes_panel(const std::vector<std::string> &notes, const std::string &next_slide)
+{
+    int width = COLS - 4;
+    if (width < 10)
+        return;
+
+    // Notes are wrapped at word boundaries; a note's own line breaks are kept
+    std::vector<std::string> rows;
+    for (const auto &note : notes)
+    {
+        size_t start = 0;
+        while (start <= note.size())
+        {
+            size_t end = std::min(note.find('\n', start), note.size());
+            std::string line = note.substr(start, end - start);
+            while ((int)line.length() > width)
+            {
+                size_t cut = line.rfind(' ', width);
+                if (cut == std::string::npos || cut == 0)
+                    cut = width;
+                rows.push_back(line.substr(0, cut));
+                size_t next = line.find_first_not_of(' ', cut);
+                line.erase(0, next == std::string::npos ? line.size() : next);
+            }
+            rows.push_back(line);
+            start = end + 1;
+        }
+    }
+
+    // Above the message row, taking at most half of the slide area
+    int bottom = LINES - 6;
+    int shown = std::min((int)rows.size(), std::max((LINES - 8) / 2 - 1, 0));
+    int top = bottom - shown;
+    if (top < 2)
+        return;
+
+    attron(COLOR_PAIR(4));
+    mvhline(top, 0, '-', COLS);
+    attroff(COLOR_PAIR(4));
+    std::string label = "[ Notes | " + next_slide + " ]";
+    attron(COLOR_PAIR(1) | A_BOLD);
+    mvaddnstr(top, 2, label.c_str(), width);
+    attroff(COLOR_PAIR(1) | A_BOLD);
+
+    attron(COLOR_PAIR(3));
+    for (int i = 0; i < shown; ++i)
+    {
+        mvhline(top + 1 + i, 0, ' ', COLS);
+        mvaddnstr(top + 1 + i, 2, rows[i].c_str(), width);
+    }
+    attroff(COLOR_PAIR(3));
 }
 
 int NCursesRenderer::get_input()
 {
-    return getch();
+    return InputRecorder::instance().read_key();
+}
+
+int NCursesRenderer::poll_input()
+{
+    nodelay(stdscr, TRUE);
+    int ch = InputRecorder::instance().read_key();
+    nodelay(stdscr, FALSE);
+    return ch;
 }
 
 int NCursesRenderer::get_screen_width() const
@@ -222,27 +401,99 @@ int NCursesRenderer::get_screen_height() const
 
 void NCursesRenderer::enable_echo()
 {
-    echo();
+    echo_input = true;
 }
 
 void NCursesRenderer::disable_echo()
 {
-    noecho();
+    echo_input = false;
 }
 
 void NCursesRenderer::get_string(char *buffer, int max_length)
 {
-    getnstr(buffer, max_length - 1);
+    // Key by key rather than getnstr(), so the keys are recorded and replayed
+    // like all others. ESC gives up and returns an empty string.
+    int length = 0;
+    int ch;
+    while ((ch = InputRecorder::instance().read_key()) != '\n' && ch != '\r' && ch != KEY_ENTER)
+    {
+        if (ch == 27 || ch == ERR)
+        {
+            length = 0;
+            break;
+        }
+        if ((ch == KEY_BACKSPACE || ch == 127 || ch == '\b') && length > 0)
+        {
+            length--;
+            if (echo_input)
+            {
+                int y, x;
+                getyx(stdscr, y, x);
+                mvaddch(y, x - 1, ' ');
+                move(y, x - 1);
+            }
+        }
+        else if (ch >= ' ' && ch < 127 && length < max_length - 1)
+        {
+            buffer[length++] = (char)ch;
+            if (echo_input)
+                addch(ch);
+        }
+        refresh();
+    }
+    buffer[length] = '\0';
+}
+
+void NCursesRenderer::apply_theme(int theme_index)
+{
+    theme_manager.setup_theme(theme_index);
+}
+
+int NCursesRenderer::get_theme_count() const
+{
+    return theme_manager.get_theme_count();
+}
+
+std::string NCursesRenderer::get_theme_name(int theme_index) const
+{
+    return theme_manager.get_theme_name(theme_index);
+}
+
+const ThemeConfig &NCursesRenderer::get_theme_config(int theme_index) const
+{
+    return theme_manager.get_theme_config(theme_index);
 }
 
-void NCursesRenderer::apply_theme(Theme theme)
+bool NCursesRenderer::load_themes(const std::string &filename, std::string &error)
 {
-    theme_manager.setup_theme(theme);
+    return theme_manager.load_palette_file(filename, error);
 }
 
 void NCursesRenderer::refresh_display()
 {
-    refresh();
+    present();
+}
+
+void NCursesRenderer::begin_frame()
+{
+    frame_depth++;
+}
+
+void NCursesRenderer::end_frame()
+{
+    if (frame_depth > 0 && --frame_depth == 0)
+    {
+        refresh();
+    }
+}
+
+void NCursesRenderer::present()
+{
+    // Inside a frame the screen is flushed once, by end_frame()
+    if (frame_depth == 0)
+    {
+        refresh();
+    }
 }
 
 void NCursesRenderer::sleep_ms(int milliseconds)
@@ -402,12 +653,13 @@ void NCursesRenderer::render_element_animated(const SlideElement &element)
     case AnimationType::TYPEWRITER:
     {
         attron(attrs);
-        for (size_t i = 0; i <= element.content.length(); ++i)
+        for (size_t i = 0; i < element.content.length() && !check_for_input_during_animation(); ++i)
         {
             safe_mvprintw(element.y, element.x, element.content.substr(0, i));
-            refresh();
+            present();
             std::this_thread::sleep_for(std::chrono::milliseconds(30));
         }
+        safe_mvprintw(element.y, element.x, element.content);
         attroff(attrs);
         break;
     }
@@ -416,7 +668,7 @@ void NCursesRenderer::render_element_animated(const SlideElement &element)
     {
         attron(attrs);
         int start_x = element.x + element.content.length() + 10;
-        for (int x = start_x; x >= element.x; x -= 3)
+        for (int x = start_x; x >= element.x && !check_for_input_during_animation(); x -= 3)
         {
             // Clear line with background color
             attron(COLOR_PAIR(0));
@@ -429,7 +681,7 @@ void NCursesRenderer::render_element_animated(const SlideElement &element)
             attron(attrs);
             safe_mvprintw(element.y, std::max(x, element.x), element.content);
             attroff(attrs);
-            refresh();
+            present();
             std::this_thread::sleep_for(std::chrono::milliseconds(30));
         }
         // Final clear and print
@@ -450,14 +702,17 @@ void NCursesRenderer::render_element_animated(const SlideElement &element)
     {
         for (int i = 0; i < 4; ++i)
         {
+            // Jump straight to the final, undimmed step
+            if (i < 3 && check_for_input_during_animation())
+                i = 3;
             attron(attrs | (i < 2 ? A_DIM : 0));
             safe_mvprintw(element.y, element.x, element.content);
-            refresh();
+            present();
             std::this_thread::sleep_for(std::chrono::milliseconds(80));
             if (i < 3)
             {
                 mvprintw(element.y, element.x, "%*s", (int)element.content.length(), "");
-                refresh();
+                present();
                 std::this_thread::sleep_for(std::chrono::milliseconds(40));
             }
             attroff(attrs | A_DIM);
@@ -473,7 +728,7 @@ void NCursesRenderer::render_element_animated(const SlideElement &element)
         break;
     }
     }
-    refresh();
+    present();
 }
 
 void NCursesRenderer::render_element_instant(const SlideElement &element)
@@ -489,6 +744,13 @@ void NCursesRenderer::render_element_instant(const SlideElement &element)
     attroff(attrs);
 }
 
+bool NCursesRenderer::check_for_input_during_animation()
+{
+    // Peek at stdin without consuming anything; the main loop reads the key
+    pollfd pending = {STDIN_FILENO, POLLIN, 0};
+    return poll(&pending, 1, 0) > 0;
+}
+
 void NCursesRenderer::clear_with_background()
 {
     clear_with_background(0, LINES);
@@ -501,15 +763,20 @@ void NCursesRenderer::clear_with_background(int start_line, int end_line)
     if (end_line > LINES)
         end_line = LINES;
     attron(COLOR_PAIR(0));
-    std::string line(COLS, ' ');
     for (int y = start_line; y < end_line; ++y)
     {
-        for (int x = 0; x < COLS; ++x)
-        {
-            mvprintw(y, 0, "%s", line.c_str());
-        }
+        mvhline(y, 0, ' ', COLS);
     }
     attroff(COLOR_PAIR(0));
     move(0, 0);
-    refresh();
+
+    // Retained chrome in the cleared rows has to be drawn again
+    if (start_line < 2)
+        chrome.header_valid = false;
+    if (start_line <= LINES - 3 && end_line > LINES - 3)
+        chrome.progress_valid = false;
+    if (end_line > LINES - 2)
+        chrome.footer_valid = false;
+
+    present();
 }
\ No newline at end of file
@@ -0,0 +1,600 @@
+#include "output_buffer.hh"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+    const size_t SPILL_FLUSH_BYTES = 64 * 1024;
+    const int DEFAULT_SCREEN_ROWS = 24;
+}
+
+int OutputBuffer::sequence_length(unsigned char lead)
+{
+    if (lead >= 0xf0 && lead < 0xf8)
+        return 4;
+    if (lead >= 0xe0)
+        return lead < 0xf0 ? 3 : 1;
+    if (lead >= 0xc0)
+        return 2;
+    return 1;
+}
+
+int OutputBuffer::next_char(std::string_view text, size_t &at)
+{
+    static const unsigned char lead_masks[] = {0, 0x7f, 0x1f, 0x0f, 0x07};
+    int length = sequence_length(text[at]);
+    if (length == 1 || at + length > text.size())
+    {
+        at++;
+        return 1;
+    }
+
+    wchar_t code = (unsigned char)text[at] & lead_masks[length];
+    for (int i = 1; i < length; ++i)
+    {
+        unsigned char byte = text[at + i];
+        if ((byte & 0xc0) != 0x80)
+        {
+            at++;
+            return 1;
+        }
+        code = (code << 6) | (byte & 0x3f);
+    }
+    at += length;
+    int width = wcwidth(code);
+    return width < 0 ? 1 : width;
+}
+
+OutputBuffer::OutputBuffer(size_t ring_lines)
+    : ring(std::max(ring_lines, (size_t)2)), total_lines(0), screen_top(0), screen_rows(1), cursor_row(0),
+      cursor_column(0), changed_from(0), spilling(false)
+{
+    set_screen_rows(DEFAULT_SCREEN_ROWS);
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    spill_text.close_file();
+    spill_text_index.close_file();
+    spill_styles.close_file();
+    spill_styles_index.close_file();
+}
+
+bool OutputBuffer::SpillFile::create(std::string &error)
+{
+    const char *tmpdir = getenv("TMPDIR");
+    std::string path = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp") + "/mdslides-output-XXXXXX";
+
+    fd = mkstemp(&path[0]);
+    if (fd < 0)
+    {
+        error = "Cannot create spill file in " + path.substr(0, path.rfind('/')) + ": " + strerror(errno);
+        return false;
+    }
+    // Nothing else needs the name; the space is freed when we close it
+    unlink(path.c_str());
+    return true;
+}
+
+void OutputBuffer::SpillFile::write(const char *data, size_t length)
+{
+    if (failed)
+        return;
+    pending.append(data, length);
+    if (pending.size() >= SPILL_FLUSH_BYTES)
+        flush();
+}
+
+bool OutputBuffer::SpillFile::flush()
+{
+    size_t done = 0;
+    while (!failed && done < pending.size())
+    {
+        ssize_t count = ::write(fd, pending.data() + done, pending.size() - done);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            failed = true; // disk full; size stays at what the file holds
+        else
+        {
+            done += count;
+            size += count;
+        }
+    }
+    pending.clear();
+    return !failed;
+}
+
+const char *OutputBuffer::SpillFile::view(uint64_t end)
+{
+    if (end > mapped)
+    {
+        // Mapping past the end of the file would fault on access
+        if (!flush() || end > size)
+            return nullptr;
+        if (map)
+            munmap(map, mapped);
+
+        void *address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        map = address == MAP_FAILED ? nullptr : static_cast<char *>(address);
+        mapped = map ? size : 0;
+    }
+    return end <= mapped ? map : nullptr;
+}
+
+void OutputBuffer::SpillFile::close_file()
+{
+    if (map)
+        munmap(map, mapped);
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+    size = mapped = 0;
+    map = nullptr;
+    pending.clear();
+    failed = false;
+}
+
+bool OutputBuffer::enable_spill(std::string &error)
+{
+    if (spilling)
+        return true;
+    spilling = true;
+    if (!spill_text.create(error) || !spill_text_index.create(error) || !spill_styles.create(error) ||
+        !spill_styles_index.create(error))
+    {
+        close_spill();
+        return false;
+    }
+    return true;
+}
+
+void OutputBuffer::close_spill()
+{
+    spill_text.close_file();
+    spill_text_index.close_file();
+    spill_styles.close_file();
+    spill_styles_index.close_file();
+    spilling = false;
+}
+
+bool OutputBuffer::spill_failed() const
+{
+    return spill_text.failed || spill_text_index.failed || spill_styles.failed || spill_styles_index.failed;
+}
+
+bool OutputBuffer::is_spilling() const
+{
+    return spilling;
+}
+
+void OutputBuffer::set_screen_rows(int rows)
+{
+    // Lines leave the ring only after they have left the screen
+    screen_rows = std::max(1, std::min(rows, (int)ring.size() - 1));
+    if (cursor_row >= screen_rows)
+    {
+        scroll_screen(screen_top + cursor_row - screen_rows + 1);
+        cursor_row = screen_rows - 1;
+    }
+}
+
+void OutputBuffer::append(const std::string &data)
+{
+    append(data.data(), data.size());
+}
+
+void OutputBuffer::append(const char *data, size_t length)
+{
+    const char *end = data + length;
+    while (data < end)
+    {
+        const char *newline = static_cast<const char *>(memchr(data, '\n', end - data));
+        const char *stop = newline ? newline : end;
+
+        write_text(data, stop - data, 0);
+        if (newline)
+        {
+            carriage_return();
+            line_feed();
+        }
+        data = stop + 1;
+    }
+}
+
+void OutputBuffer::clear()
+{
+    for (auto &slot : ring)
+    {
+        slot.text.clear();
+        slot.styles.clear();
+        slot.cells = 0;
+    }
+    total_lines = 0;
+    screen_top = 0;
+    cursor_row = 0;
+    cursor_column = 0;
+    changed_from = 0;
+
+    if (spilling)
+    {
+        close_spill();
+        std::string error;
+        enable_spill(error);
+    }
+}
+
+OutputBuffer::Line &OutputBuffer::slot(size_t index)
+{
+    return ring[index % ring.size()];
+}
+
+void OutputBuffer::mark_changed(size_t index)
+{
+    changed_from = std::min(changed_from, index);
+}
+
+size_t OutputBuffer::first_changed_line() const
+{
+    return changed_from;
+}
+
+void OutputBuffer::clear_changes()
+{
+    changed_from = SIZE_MAX;
+}
+
+OutputBuffer::Line &OutputBuffer::materialize(size_t index)
+{
+    if (index >= total_lines)
+        mark_changed(total_lines);
+    while (total_lines <= index)
+    {
+        // Reuse the slot of the line falling out of the ring
+        Line &fresh = slot(total_lines);
+        fresh.text.clear();
+        fresh.styles.clear();
+        fresh.cells = 0;
+        total_lines++;
+    }
+    return slot(index);
+}
+
+void OutputBuffer::scroll_screen(size_t new_top)
+{
+    if (new_top <= screen_top)
+        return;
+    materialize(new_top - 1);
+
+    for (; screen_top < new_top; ++screen_top)
+    {
+        if (!spilling)
+            continue;
+
+        const Line &final_line = slot(screen_top);
+        uint64_t offset = spill_text.end();
+        spill_text_index.write(reinterpret_cast<const char *>(&offset), sizeof(offset));
+        spill_text.write(final_line.text.data(), final_line.text.size());
+        spill_text.write("\n", 1);
+
+        offset = spill_styles.end();
+        spill_styles_index.write(reinterpret_cast<const char *>(&offset), sizeof(offset));
+        spill_styles.write(reinterpret_cast<const char *>(final_line.styles.data()),
+                           final_line.styles.size() * sizeof(StyleRun));
+
+        // The files no longer match the lines; keep what the ring holds
+        if (spill_failed())
+            close_spill();
+    }
+}
+
+void OutputBuffer::write_text(const char *data, size_t length, uint32_t style)
+{
+    if (length == 0)
+        return;
+
+    Line &target = materialize(screen_top + cursor_row);
+    mark_changed(screen_top + cursor_row);
+    int column = cursor_column;
+    int width = 0;
+    std::string_view text(data, length);
+    for (size_t at = 0; at < length;)
+    {
+        if ((unsigned char)data[at] < 0x80)
+        {
+            at++;
+            width++;
+        }
+        else
+        {
+            width += next_char(text, at);
+        }
+    }
+    cursor_column += width;
+
+    if (column > target.cells)
+    {
+        // Text after a cursor move past the end; the gap is blank
+        if (!target.styles.empty() && target.styles.back().style != 0)
+            target.styles.push_back({(uint32_t)target.text.size(), 0});
+        target.text.append(column - target.cells, ' ');
+        target.cells = column;
+    }
+
+    if (column == target.cells)
+    {
+        // The common case: output arriving at the end of the line
+        uint32_t current = target.styles.empty() ? 0 : target.styles.back().style;
+        if (style != current)
+            target.styles.push_back({(uint32_t)target.text.size(), style});
+        target.text.append(data, length);
+        target.cells += width;
+        return;
+    }
+
+    overwrite(target, column, data, length, width, style);
+}
+
+size_t OutputBuffer::byte_at(const std::string &text, int column, int &start)
+{
+    // The character covering the cell, or the end of the text; combining
+    // marks stay with the character before them
+    size_t at = 0;
+    int cells = 0;
+    while (at < text.size())
+    {
+        size_t next = at;
+        int width = next_char(text, next);
+        if (cells + width > column)
+            break;
+        at = next;
+        cells += width;
+    }
+    start = cells;
+    return at;
+}
+
+void OutputBuffer::overwrite(Line &target, int column, const char *data, size_t length, int width, uint32_t style)
+{
+    // Whole characters covering cells column to column + width are replaced;
+    // the uncovered half of a wide one becomes a blank, as on a terminal
+    int from_cell, to_cell;
+    size_t from = byte_at(target.text, column, from_cell);
+    size_t to = byte_at(target.text, column + width, to_cell);
+    int lead_blanks = column - from_cell;
+    int tail_blanks = 0;
+    if (to_cell < column + width && to < target.text.size())
+    {
+        size_t next = to;
+        to_cell += next_char(target.text, next);
+        tail_blanks = to_cell - column - width;
+        to = next;
+        while (to < target.text.size())
+        {
+            next = to;
+            if (next_char(target.text, next) != 0)
+                break;
+            to = next;
+        }
+    }
+
+    size_t old_size = target.text.size();
+    target.cells += lead_blanks + width + tail_blanks - (to_cell - from_cell);
+    target.text.replace(from, to - from, data, length);
+    target.text.insert(from + length, tail_blanks, ' ');
+    target.text.insert(from, lead_blanks, ' ');
+    if (target.styles.empty() && style == 0)
+        return;
+
+    // Expand to one style per byte, patch, and pack back into runs
+    byte_styles.assign(old_size, 0);
+    for (size_t i = 0; i < target.styles.size(); ++i)
+    {
+        size_t run_end = i + 1 < target.styles.size() ? target.styles[i + 1].start : old_size;
+        std::fill(byte_styles.begin() + target.styles[i].start, byte_styles.begin() + run_end,
+                  target.styles[i].style);
+    }
+    uint32_t lead_style = from < old_size ? byte_styles[from] : 0;
+    uint32_t tail_style = to > from ? byte_styles[to - 1] : 0;
+    byte_styles.erase(byte_styles.begin() + from, byte_styles.begin() + to);
+    byte_styles.insert(byte_styles.begin() + from, tail_blanks, tail_style);
+    byte_styles.insert(byte_styles.begin() + from, length, style);
+    byte_styles.insert(byte_styles.begin() + from, lead_blanks, lead_style);
+
+    target.styles.clear();
+    uint32_t current = 0;
+    for (size_t i = 0; i < byte_styles.size(); ++i)
+    {
+        if (byte_styles[i] != current)
+        {
+            current = byte_styles[i];
+            target.styles.push_back({(uint32_t)i, current});
+        }
+    }
+}
+
+void OutputBuffer::line_feed()
+{
+    if (cursor_row + 1 < screen_rows)
+        cursor_row++;
+    else
+        scroll_screen(screen_top + 1);
+}
+
+void OutputBuffer::carriage_return()
+{
+    cursor_column = 0;
+}
+
+void OutputBuffer::move_cursor(int row, int column)
+{
+    cursor_row = std::max(0, std::min(row, screen_rows - 1));
+    cursor_column = std::max(0, column);
+}
+
+void OutputBuffer::move_cursor_by(int rows, int columns)
+{
+    move_cursor(cursor_row + rows, cursor_column + columns);
+}
+
+int OutputBuffer::get_cursor_row() const
+{
+    return cursor_row;
+}
+
+int OutputBuffer::get_cursor_column() const
+{
+    return cursor_column;
+}
+
+void OutputBuffer::erase_in_line(int mode)
+{
+    size_t index = screen_top + cursor_row;
+    if (index >= total_lines)
+        return;
+
+    Line &target = slot(index);
+    mark_changed(index);
+    if (mode == 0)
+    {
+        // A wide character under the cursor goes as a whole
+        int start;
+        size_t from = byte_at(target.text, cursor_column, start);
+        target.text.resize(from);
+        target.cells = start;
+        while (!target.styles.empty() && target.styles.back().start >= from)
+            target.styles.pop_back();
+    }
+    else if (mode == 1)
+    {
+        static const char blanks[] = "                                ";
+        int end = std::min(cursor_column + 1, target.cells);
+        for (int done = 0; done < end;)
+        {
+            int count = std::min(end - done, (int)sizeof(blanks) - 1);
+            overwrite(target, done, blanks, count, count, 0);
+            done += count;
+        }
+    }
+    else
+    {
+        target.text.clear();
+        target.styles.clear();
+        target.cells = 0;
+    }
+}
+
+void OutputBuffer::erase_in_display(int mode)
+{
+    if (mode >= 2)
+    {
+        // Keep what was on screen as scrollback and start a blank screen
+        scroll_screen(total_lines);
+        return;
+    }
+
+    size_t cursor_line = screen_top + cursor_row;
+    size_t first = mode == 0 ? cursor_line + 1 : screen_top;
+    size_t last = mode == 0 ? total_lines : std::min(cursor_line, total_lines);
+    if (first < last)
+        mark_changed(first);
+    for (size_t index = first; index < last; ++index)
+    {
+        slot(index).text.clear();
+        slot(index).styles.clear();
+        slot(index).cells = 0;
+    }
+    erase_in_line(mode);
+}
+
+size_t OutputBuffer::line_count() const
+{
+    return total_lines;
+}
+
+size_t OutputBuffer::first_line() const
+{
+    if (spilling || total_lines <= ring.size())
+        return 0;
+    return total_lines - ring.size();
+}
+
+bool OutputBuffer::spilled_range(SpillFile &index_file, SpillFile &data_file, size_t index, uint64_t &start,
+                                 uint64_t &end)
+{
+    // Final lines are complete, so both offsets are in the files
+    uint64_t index_end = (index + 1) * sizeof(uint64_t);
+    const char *offsets = index_file.view(index_end);
+    if (!offsets)
+        return false;
+    memcpy(&start, offsets + index * sizeof(uint64_t), sizeof(start));
+
+    if (index_end < index_file.end())
+    {
+        const char *following = index_file.view(index_end + sizeof(uint64_t));
+        if (!following)
+            return false;
+        memcpy(&end, following + index_end, sizeof(end));
+    }
+    else
+    {
+        end = data_file.end();
+    }
+    return end >= start;
+}
+
+std::string_view OutputBuffer::line(size_t index)
+{
+    if (index >= total_lines)
+        return {};
+
+    if (index + ring.size() >= total_lines)
+        return slot(index).text;
+
+    uint64_t start, end;
+    if (!spilling)
+        return {};
+    const char *data = nullptr;
+    if (spilled_range(spill_text_index, spill_text, index, start, end))
+        data = spill_text.view(end);
+    // A failed flush leaves the spill to the next write: closing it here
+    // would unmap lines the caller may still hold
+    if (!data || end <= start)
+        return {};
+    return std::string_view(data + start, end - start - 1);
+}
+
+void OutputBuffer::line_styles(size_t index, std::vector<StyleRun> &runs)
+{
+    runs.clear();
+    if (index >= total_lines)
+        return;
+
+    if (index + ring.size() >= total_lines)
+    {
+        const auto &styles = slot(index).styles;
+        runs.assign(styles.begin(), styles.end());
+        return;
+    }
+
+    uint64_t start, end;
+    if (!spilling)
+        return;
+    const char *data = nullptr;
+    if (spilled_range(spill_styles_index, spill_styles, index, start, end))
+    {
+        if (end == start)
+            return;
+        data = spill_styles.view(end);
+    }
+    if (!data)
+        return;
+    runs.resize((end - start) / sizeof(StyleRun));
+    memcpy(runs.data(), data + start, runs.size() * sizeof(StyleRun));
+}
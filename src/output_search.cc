@@ -0,0 +1,104 @@
+#include "output_search.hh"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+OutputSearch::OutputSearch() : ignore_case(false), first_lower(0), first_upper(0)
+{
+}
+
+void OutputSearch::set_pattern(const std::string &new_pattern)
+{
+    pattern = new_pattern;
+    ignore_case = std::none_of(pattern.begin(), pattern.end(), [](unsigned char ch)
+                               { return std::isupper(ch); });
+    if (!pattern.empty())
+    {
+        first_lower = (unsigned char)std::tolower((unsigned char)pattern[0]);
+        first_upper = (unsigned char)std::toupper((unsigned char)pattern[0]);
+    }
+}
+
+const std::string &OutputSearch::get_pattern() const
+{
+    return pattern;
+}
+
+bool OutputSearch::is_active() const
+{
+    return !pattern.empty();
+}
+
+bool OutputSearch::matches_at(const char *text) const
+{
+    for (size_t i = 1; i < pattern.size(); ++i)
+    {
+        if (std::tolower((unsigned char)text[i]) != (unsigned char)pattern[i])
+            return false;
+    }
+    return true;
+}
+
+size_t OutputSearch::find(std::string_view text, size_t from) const
+{
+    if (pattern.empty() || from >= text.size() || text.size() - from < pattern.size())
+        return NOT_FOUND;
+
+    const char *start = text.data() + from;
+    size_t length = text.size() - from;
+    if (!ignore_case)
+    {
+        const void *found = memmem(start, length, pattern.data(), pattern.size());
+        return found ? static_cast<const char *>(found) - text.data() : NOT_FOUND;
+    }
+
+    // Candidates are the next lower- or upper-case first byte; each memchr
+    // result is kept until passed, so neither case is scanned twice
+    const char *last = start + length - pattern.size();
+    const char *next_lower = nullptr;
+    const char *next_upper = first_lower == first_upper ? last + 1 : nullptr;
+    const char *position = start;
+    while (position <= last)
+    {
+        if (!next_lower || next_lower < position)
+        {
+            next_lower = static_cast<const char *>(memchr(position, first_lower, last - position + 1));
+            if (!next_lower)
+                next_lower = last + 1;
+        }
+        if (!next_upper || next_upper < position)
+        {
+            next_upper = static_cast<const char *>(memchr(position, first_upper, last - position + 1));
+            if (!next_upper)
+                next_upper = last + 1;
+        }
+
+        const char *candidate = std::min(next_lower, next_upper);
+        if (candidate > last)
+            break;
+        if (matches_at(candidate))
+            return candidate - text.data();
+        position = candidate + 1;
+    }
+    return NOT_FOUND;
+}
+
+size_t OutputSearch::find_line(OutputBuffer &buffer, size_t from, size_t to) const
+{
+    for (size_t line = from; line < to; ++line)
+    {
+        if (find(buffer.line(line)) != NOT_FOUND)
+            return line;
+    }
+    return NOT_FOUND;
+}
+
+size_t OutputSearch::find_line_backward(OutputBuffer &buffer, size_t from, size_t to) const
+{
+    for (size_t line = to; line > from; --line)
+    {
+        if (find(buffer.line(line - 1)) != NOT_FOUND)
+            return line - 1;
+    }
+    return NOT_FOUND;
+}
@@ -0,0 +1,538 @@
+#include "output_view.hh"
+#include "ansi_parser.hh"
+#include "theme_config.hh"
+#include <ncurses.h>
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string_view>
+
+namespace
+{
+    // Pairs 0-9 belong to the theme; output colours get the rest on demand
+    const int FIRST_OUTPUT_PAIR = 16;
+
+    void pair_colors(int pair, int &foreground, int &background)
+    {
+#if defined(NCURSES_EXT_COLORS)
+        extended_pair_content(pair, &foreground, &background);
+#else
+        short fg = 0, bg = 0;
+        pair_content(pair, &fg, &bg);
+        foreground = fg;
+        background = bg;
+#endif
+    }
+
+    // Output pairs are resolved against the theme, so a new theme starts over
+    std::map<std::pair<int, int>, int> pairs;
+    int next_pair = FIRST_OUTPUT_PAIR;
+    int color_generation = 0;
+
+    int output_pair(int foreground, int background, int fallback)
+    {
+        auto found = pairs.find({foreground, background});
+        if (found != pairs.end())
+            return found->second;
+        // COLOR_PAIR() has room for 256 pairs
+        if (next_pair >= std::min(COLOR_PAIRS, 256))
+            return fallback;
+
+        ThemeManager::init_color_pair(next_pair, foreground, background);
+        pairs[{foreground, background}] = next_pair;
+        return next_pair++;
+    }
+
+    int style_attributes(uint32_t style, int color_pair)
+    {
+        if (style == 0)
+            return COLOR_PAIR(color_pair);
+
+        int attrs = 0;
+        if (style & AnsiParser::BOLD)
+            attrs |= A_BOLD;
+        if (style & AnsiParser::DIM)
+            attrs |= A_DIM;
+        if (style & AnsiParser::ITALIC)
+            attrs |= A_ITALIC;
+        if (style & AnsiParser::UNDERLINE)
+            attrs |= A_UNDERLINE;
+        if (style & AnsiParser::REVERSE)
+            attrs |= A_REVERSE;
+
+        int fg = AnsiParser::foreground(style);
+        int bg = AnsiParser::background(style);
+        if ((fg < 0 && bg < 0) || !has_colors())
+            return attrs | COLOR_PAIR(color_pair);
+
+        // Unset colours come from the view's own pair
+        int default_fg, default_bg;
+        pair_colors(color_pair, default_fg, default_bg);
+        fg = fg < 0 ? default_fg : ThemeManager::resolve_color(fg);
+        bg = bg < 0 ? default_bg : ThemeManager::resolve_color(bg);
+        return attrs | COLOR_PAIR(output_pair(fg, bg, color_pair));
+    }
+
+    // Wraps text into rows of width cells, a wide character that would
+    // straddle the edge starting the next row. Returns the number of rows
+    // and sets the byte range of row, empty past the last one.
+    int wrap(std::string_view text, int width, int row, size_t &start, size_t &end)
+    {
+        start = end = row == 0 ? 0 : text.size();
+        // No character takes more cells than bytes
+        if (text.size() <= (size_t)width)
+        {
+            if (row == 0)
+                end = text.size();
+            return 1;
+        }
+
+        int rows = 1;
+        int cells = 0;
+        for (size_t at = 0; at < text.size();)
+        {
+            size_t next = at;
+            int columns = OutputBuffer::next_char(text, next);
+            if (cells > 0 && cells + columns > width)
+            {
+                if (rows - 1 == row)
+                    end = at;
+                if (rows == row)
+                    start = at;
+                rows++;
+                cells = 0;
+            }
+            cells += columns;
+            at = next;
+        }
+        if (rows - 1 == row)
+            end = text.size();
+        return rows;
+    }
+}
+
+OutputView::OutputView()
+    : buffer(nullptr), area_y(0), area_x(0), area_height(1), area_width(1), top_line(0), top_row(0),
+      following(true), end_line(0), has_more_below(false), highlight(nullptr), pad_valid(false), pad_line(0), pad_row(0),
+      pad_color_pair(-1), pad_generation(color_generation)
+{
+}
+
+void OutputView::reset_colors()
+{
+    pairs.clear();
+    next_pair = FIRST_OUTPUT_PAIR;
+    color_generation++;
+}
+
+void OutputView::PadDeleter::operator()(WINDOW *window) const
+{
+    delwin(window);
+}
+
+void OutputView::set_buffer(OutputBuffer *output)
+{
+    buffer = output;
+    top_line = 0;
+    top_row = 0;
+    following = true;
+    pad_valid = false;
+    update();
+}
+
+void OutputView::set_area(int y, int x, int height, int width)
+{
+    area_y = y;
+    area_x = x;
+    height = std::max(height, 1);
+    width = std::max(width, 1);
+    if (height != area_height || width != area_width)
+    {
+        // Made again at the new size on the next draw
+        pad.reset();
+        pad_valid = false;
+    }
+    area_height = height;
+    area_width = width;
+
+    // Only the top line's wrap position depends on the width
+    if (following)
+        scroll_to_end();
+    else if (buffer)
+        top_row = std::min(top_row, rows_of(top_line) - 1);
+}
+
+int OutputView::rows_of(size_t line)
+{
+    size_t start, end;
+    return wrap(buffer->line(line), area_width, 0, start, end);
+}
+
+bool OutputView::step_forward(size_t &line, int &row)
+{
+    if (row + 1 < rows_of(line))
+    {
+        row++;
+    }
+    else
+    {
+        line++;
+        row = 0;
+    }
+    return line < buffer->line_count();
+}
+
+bool OutputView::step_back(size_t &line, int &row)
+{
+    if (row > 0)
+    {
+        row--;
+    }
+    else if (line > buffer->first_line())
+    {
+        line--;
+        row = rows_of(line) - 1;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+int OutputView::rows_between(size_t from_line, int from_row, size_t to_line, int to_row, int limit)
+{
+    // Forward distance in rows, or -1 if to is not within limit rows
+    for (int distance = 0; distance <= limit; ++distance)
+    {
+        if (from_line == to_line && from_row == to_row)
+            return distance;
+        if (from_line > to_line)
+            break;
+        step_forward(from_line, from_row);
+    }
+    return -1;
+}
+
+void OutputView::scroll_to_start()
+{
+    following = false;
+    top_line = buffer ? buffer->first_line() : 0;
+    top_row = 0;
+}
+
+void OutputView::scroll_to_end()
+{
+    following = true;
+    if (!buffer)
+        return;
+
+    // Walk back from the last line until a screenful of rows is covered
+    int rows_needed = area_height;
+    size_t first = buffer->first_line();
+    size_t line = buffer->line_count();
+    top_line = first;
+    top_row = 0;
+
+    while (line > first && rows_needed > 0)
+    {
+        line--;
+        int rows = rows_of(line);
+        if (rows >= rows_needed)
+        {
+            top_line = line;
+            top_row = rows - rows_needed;
+            return;
+        }
+        rows_needed -= rows;
+    }
+}
+
+void OutputView::scroll_down(int rows)
+{
+    if (!buffer)
+        return;
+
+    size_t last_line = top_line;
+    int last_row = top_row;
+    scroll_to_end();
+    size_t last_screen_line = top_line;
+    int last_screen_row = top_row;
+
+    // Step forward from where we were, stopping at the last screenful
+    top_line = last_line;
+    top_row = last_row;
+    for (int i = 0; i < rows && (top_line < last_screen_line ||
+                                 (top_line == last_screen_line && top_row < last_screen_row));
+         ++i)
+    {
+        step_forward(top_line, top_row);
+    }
+    following = top_line > last_screen_line || (top_line == last_screen_line && top_row >= last_screen_row);
+}
+
+void OutputView::scroll_up(int rows)
+{
+    if (!buffer)
+        return;
+
+    following = false;
+    for (int i = 0; i < rows; ++i)
+    {
+        if (!step_back(top_line, top_row))
+            break;
+    }
+}
+
+void OutputView::update()
+{
+    if (!buffer)
+        return;
+
+    if (following)
+    {
+        scroll_to_end();
+    }
+    else if (top_line < buffer->first_line())
+    {
+        // The lines on screen have dropped out of the ring
+        top_line = buffer->first_line();
+        top_row = 0;
+    }
+}
+
+void OutputView::show_line(size_t line)
+{
+    if (!buffer)
+        return;
+    if ((line == top_line && top_row == 0) || (line > top_line && line + 1 < end_line))
+        return;
+
+    // Never past the last screenful
+    scroll_to_end();
+    if (line < top_line || (line == top_line && top_row > 0))
+    {
+        top_line = std::max(line, buffer->first_line());
+        top_row = 0;
+        following = false;
+    }
+}
+
+void OutputView::set_highlight(const OutputSearch *search)
+{
+    highlight = search && search->is_active() ? search : nullptr;
+    pad_valid = false;
+}
+
+void OutputView::draw(int color_pair)
+{
+    if (!pad)
+    {
+        pad.reset(newpad(area_height, area_width));
+        if (!pad)
+            return;
+        wbkgdset(pad.get(), ' ' | COLOR_PAIR(0));
+        pad_valid = false;
+    }
+    if (!buffer || color_pair != pad_color_pair || pad_generation != color_generation ||
+        pad_line < buffer->first_line())
+        pad_valid = false;
+
+    end_line = top_line;
+    has_more_below = false;
+    if (!buffer)
+    {
+        werase(pad.get());
+    }
+    else if (!pad_valid)
+    {
+        render_rows(0, area_height, top_line, top_row, color_pair);
+        buffer->clear_changes();
+    }
+    else
+    {
+        scroll_pad(color_pair);
+
+        // Re-render from the first row showing a line that changed
+        size_t changed = buffer->first_changed_line();
+        buffer->clear_changes();
+        size_t line = top_line;
+        int row = top_row;
+        for (int pad_row_index = 0; changed != SIZE_MAX && pad_row_index < area_height; ++pad_row_index)
+        {
+            if (line >= changed)
+            {
+                render_rows(pad_row_index, area_height - pad_row_index, line, row, color_pair);
+                break;
+            }
+            step_forward(line, row);
+        }
+    }
+
+    pad_valid = buffer != nullptr;
+    pad_line = top_line;
+    pad_row = top_row;
+    pad_color_pair = color_pair;
+    pad_generation = color_generation;
+
+    // Cells that did not change are left alone by the next refresh
+    copywin(pad.get(), stdscr, 0, 0, area_y, area_x, std::min(area_y + area_height, LINES) - 1,
+            std::min(area_x + area_width, COLS) - 1, FALSE);
+
+    if (!buffer)
+        return;
+    size_t line = top_line;
+    int row = top_row;
+    size_t line_count = buffer->line_count();
+    for (int display_row = 0; display_row < area_height && line < line_count; ++display_row)
+    {
+        step_forward(line, row);
+    }
+    end_line = row > 0 ? line + 1 : line;
+    has_more_below = line < line_count;
+}
+
+void OutputView::scroll_pad(int color_pair)
+{
+    // Shift what the pad holds and render only the rows coming into view
+    int limit = area_height - 1;
+    int distance = rows_between(pad_line, pad_row, top_line, top_row, limit);
+    if (distance < 0)
+    {
+        int back = rows_between(top_line, top_row, pad_line, pad_row, limit);
+        if (back < 0)
+        {
+            render_rows(0, area_height, top_line, top_row, color_pair);
+            return;
+        }
+        distance = -back;
+    }
+    if (distance == 0)
+        return;
+
+    // Only here: text reaching the bottom-right corner must not scroll the pad
+    scrollok(pad.get(), TRUE);
+    wscrl(pad.get(), distance);
+    scrollok(pad.get(), FALSE);
+    if (distance < 0)
+    {
+        render_rows(0, -distance, top_line, top_row, color_pair);
+        return;
+    }
+
+    size_t line = top_line;
+    int row = top_row;
+    for (int i = 0; i < area_height - distance; ++i)
+    {
+        step_forward(line, row);
+    }
+    render_rows(area_height - distance, distance, line, row, color_pair);
+}
+
+void OutputView::render_rows(int first, int count, size_t line, int row, int color_pair)
+{
+    WINDOW *window = pad.get();
+    size_t line_count = buffer->line_count();
+    size_t styled_line = SIZE_MAX;
+
+    for (int pad_row_index = first; pad_row_index < first + count && pad_row_index < area_height; ++pad_row_index)
+    {
+        wmove(window, pad_row_index, 0);
+        wclrtoeol(window);
+        if (line >= line_count)
+            continue;
+
+        std::string_view text = buffer->line(line);
+        if (styled_line != line)
+        {
+            buffer->line_styles(line, styles);
+            find_matches(text);
+            styled_line = line;
+        }
+
+        size_t start, end;
+        wrap(text, area_width, row, start, end);
+        if (start < end)
+            draw_styled(text, start, end, color_pair);
+        step_forward(line, row);
+    }
+}
+
+void OutputView::find_matches(std::string_view text)
+{
+    matches.clear();
+    if (!highlight)
+        return;
+
+    size_t length = highlight->get_pattern().size();
+    for (size_t found = highlight->find(text); found != OutputSearch::NOT_FOUND;
+         found = highlight->find(text, found + length))
+    {
+        matches.emplace_back(found, found + length);
+    }
+}
+
+void OutputView::draw_styled(std::string_view text, size_t start, size_t end, int color_pair)
+{
+    // Find the style run and match covering start, then draw one piece per
+    // style change or match boundary
+    size_t run = 0;
+    uint32_t style = 0;
+    while (run < styles.size() && styles[run].start <= start)
+        style = styles[run++].style;
+    size_t match = 0;
+    while (match < matches.size() && matches[match].second <= start)
+        match++;
+
+    size_t position = start;
+    while (position < end)
+    {
+        bool in_match = match < matches.size() && matches[match].first <= position;
+        size_t next = end;
+        if (run < styles.size())
+            next = std::min(next, (size_t)styles[run].start);
+        if (match < matches.size())
+            next = std::min(next, in_match ? matches[match].second : matches[match].first);
+
+        int attrs = style_attributes(style, color_pair) | (in_match ? A_REVERSE : 0);
+        wattron(pad.get(), attrs);
+        waddnstr(pad.get(), text.data() + position, (int)(next - position));
+        wattroff(pad.get(), attrs);
+
+        position = next;
+        if (run < styles.size() && styles[run].start <= position)
+            style = styles[run++].style;
+        if (match < matches.size() && matches[match].second <= position)
+            match++;
+    }
+}
+
+int OutputView::get_height() const
+{
+    return area_height;
+}
+
+int OutputView::get_width() const
+{
+    return area_width;
+}
+
+size_t OutputView::get_top_line() const
+{
+    return top_line;
+}
+
+size_t OutputView::get_end_line() const
+{
+    return end_line;
+}
+
+bool OutputView::more_above() const
+{
+    return buffer && (top_line > buffer->first_line() || top_row > 0);
+}
+
+bool OutputView::more_below() const
+{
+    return has_more_below;
+}
@@ -0,0 +1,158 @@
+#include "phase_profiler.hh"
+#include "trace_recorder.hh"
+#include <cstdio>
+
+LatencyHistogram::LatencyHistogram() : count(0), total(0), max_value(0)
+{
+    buckets.fill(0);
+}
+
+int LatencyHistogram::bucket_index(uint64_t value)
+{
+    if (value < (1u << SUB_BUCKET_BITS))
+        return static_cast<int>(value);
+
+    int exponent = 63 - __builtin_clzll(value);
+    int sub_bucket = static_cast<int>((value >> (exponent - SUB_BUCKET_BITS)) & ((1u << SUB_BUCKET_BITS) - 1));
+    return ((exponent - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + sub_bucket;
+}
+
+uint64_t LatencyHistogram::bucket_midpoint(int index)
+{
+    if (index < (1 << SUB_BUCKET_BITS))
+        return static_cast<uint64_t>(index);
+
+    int exponent = (index >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+    uint64_t sub_bucket = index & ((1 << SUB_BUCKET_BITS) - 1);
+    uint64_t width = 1ull << (exponent - SUB_BUCKET_BITS);
+    uint64_t lower = (1ull << exponent) + sub_bucket * width;
+    return lower + width / 2;
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds)
+{
+    buckets[bucket_index(nanoseconds)]++;
+    count++;
+    total += nanoseconds;
+    if (nanoseconds > max_value)
+        max_value = nanoseconds;
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const
+{
+    if (count == 0)
+        return 0;
+
+    uint64_t target = static_cast<uint64_t>(fraction * count + 0.5);
+    if (target == 0)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= target)
+        {
+            uint64_t value = bucket_midpoint(i);
+            return value > max_value ? max_value : value;
+        }
+    }
+    return max_value;
+}
+
+uint64_t LatencyHistogram::get_count() const
+{
+    return count;
+}
+
+uint64_t LatencyHistogram::get_max() const
+{
+    return max_value;
+}
+
+uint64_t LatencyHistogram::get_mean() const
+{
+    return count ? total / count : 0;
+}
+
+PhaseProfiler::PhaseProfiler() : enabled(false)
+{
+}
+
+PhaseProfiler &PhaseProfiler::instance()
+{
+    static PhaseProfiler profiler;
+    return profiler;
+}
+
+void PhaseProfiler::set_enabled(bool value)
+{
+    enabled = value;
+}
+
+void PhaseProfiler::record(Phase phase, uint64_t nanoseconds)
+{
+    std::lock_guard<std::mutex> lock(record_mutex);
+    histograms[static_cast<int>(phase)].record(nanoseconds);
+}
+
+const char *PhaseProfiler::phase_name(Phase phase)
+{
+    static const char *names[] = {"load_slides", "parse_slide", "layout", "render_slide",
+                                  "draw_header", "draw_footer", "draw_progress_bar", "refresh",
+                                  "index_deck", "search_deck", "export_slide"};
+    return names[static_cast<int>(phase)];
+}
+
+bool PhaseProfiler::write_json(const std::string &filename) const
+{
+    FILE *file = fopen(filename.c_str(), "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "{\n  \"unit\": \"us\",\n  \"phases\": {");
+    bool first = true;
+    for (int i = 0; i < static_cast<int>(Phase::COUNT); ++i)
+    {
+        const LatencyHistogram &histogram = histograms[i];
+        if (histogram.get_count() == 0)
+            continue;
+
+        fprintf(file, "%s\n    \"%s\": {\"count\": %llu, \"p50\": %.1f, \"p95\": %.1f, \"p99\": %.1f, "
+                      "\"max\": %.1f, \"mean\": %.1f}",
+                first ? "" : ",", phase_name(static_cast<Phase>(i)),
+                (unsigned long long)histogram.get_count(),
+                histogram.percentile(0.50) / 1000.0, histogram.percentile(0.95) / 1000.0,
+                histogram.percentile(0.99) / 1000.0, histogram.get_max() / 1000.0,
+                histogram.get_mean() / 1000.0);
+        first = false;
+    }
+    fprintf(file, "\n  }\n}\n");
+
+    return fclose(file) == 0;
+}
+
+ScopedPhase::ScopedPhase(Phase p)
+    : phase(p), profiling(PhaseProfiler::instance().is_enabled()),
+      tracing(TraceRecorder::instance().is_enabled()), trace_start_us(0)
+{
+    if (profiling)
+        start = std::chrono::steady_clock::now();
+    if (tracing)
+        trace_start_us = TraceRecorder::instance().now_us();
+}
+
+ScopedPhase::~ScopedPhase()
+{
+    if (profiling)
+    {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        PhaseProfiler::instance().record(
+            phase, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+    if (tracing)
+    {
+        TraceRecorder &tracer = TraceRecorder::instance();
+        tracer.complete(PhaseProfiler::phase_name(phase), "phase", trace_start_us, tracer.now_us());
+    }
+}
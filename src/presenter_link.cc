@@ -0,0 +1,299 @@
+#include "presenter_link.hh"
+#include "event_loop.hh"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    const int RETRY_MS = 1000;
+    const long MAX_TEXT = 64 << 20; // a header announcing more is not ours
+
+    bool make_address(const std::string &path, sockaddr_un &address, std::string &error)
+    {
+        address = {};
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path))
+        {
+            error = "Socket path is empty or too long: " + path;
+            return false;
+        }
+        memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+}
+
+PresenterLink::PresenterLink()
+    : loop(nullptr), presenting(false), following(false), peer_fd(-1), retry_timer_fd(-1)
+{
+}
+
+PresenterLink::~PresenterLink()
+{
+    // The event loop may be gone already; only the descriptors are released
+    if (peer_fd >= 0)
+        ::close(peer_fd);
+    if (server)
+    {
+        server->stop();
+        unlink(socket_path.c_str());
+    }
+}
+
+bool PresenterLink::is_presenter() const
+{
+    return presenting;
+}
+
+bool PresenterLink::is_follower() const
+{
+    return following;
+}
+
+bool PresenterLink::is_connected() const
+{
+    return peer_fd >= 0;
+}
+
+size_t PresenterLink::get_follower_count() const
+{
+    return server ? server->get_follower_count() : 0;
+}
+
+bool PresenterLink::listen(const std::string &path, EventLoop &event_loop,
+                           std::function<void(std::vector<Message> &)> state, std::string &error)
+{
+    sockaddr_un address;
+    if (!make_address(path, address, error))
+        return false;
+
+    // A socket left behind by a presenter that died is replaced; a live one is not
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0)
+    {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool alive = S_ISSOCK(info.st_mode) && probe >= 0 &&
+                     connect(probe, (const sockaddr *)&address, sizeof(address)) == 0;
+        if (probe >= 0)
+            ::close(probe);
+        if (alive || !S_ISSOCK(info.st_mode))
+        {
+            error = alive ? "Another presenter is using " + path : path + " exists and is not a socket";
+            return false;
+        }
+        unlink(path.c_str());
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 || bind(listen_fd, (const sockaddr *)&address, sizeof(address)) < 0 ||
+        ::listen(listen_fd, SOMAXCONN) < 0)
+    {
+        error = "Cannot listen on " + path + ": " + strerror(errno);
+        if (listen_fd >= 0)
+            ::close(listen_fd);
+        return false;
+    }
+    server = std::make_unique<BroadcastServer>();
+    if (!server->start(listen_fd, error))
+    {
+        server.reset();
+        ::close(listen_fd);
+        unlink(path.c_str());
+        return false;
+    }
+
+    loop = &event_loop;
+    socket_path = path;
+    presenting = true;
+    state_source = std::move(state);
+    loop->add_fd(server->joined_fd(), [this](uint32_t)
+                 { send_state(); });
+    return true;
+}
+
+void PresenterLink::send_state()
+{
+    // Built here, where the state lives, and queued behind every change so far
+    std::vector<uint64_t> joined;
+    server->take_joined(joined);
+    if (joined.empty())
+        return;
+
+    std::vector<Message> state;
+    if (state_source)
+        state_source(state);
+    std::string data;
+    for (const auto &message : state)
+    {
+        encode(message, data);
+    }
+    for (uint64_t follower : joined)
+    {
+        server->send_to(follower, data);
+    }
+}
+
+void PresenterLink::send(const Message &message)
+{
+    // A follower still connecting gets the state, which includes this change
+    if (!server || server->get_follower_count() == 0)
+        return;
+    std::string data;
+    encode(message, data);
+    server->broadcast(std::move(data));
+}
+
+void PresenterLink::drop_peer()
+{
+    if (peer_fd < 0)
+        return;
+    loop->remove_fd(peer_fd);
+    ::close(peer_fd);
+    peer_fd = -1;
+    inbox.clear();
+
+    if (following)
+    {
+        if (connection_handler)
+            connection_handler(false);
+        retry_timer_fd = loop->add_timer(RETRY_MS, RETRY_MS, [this]()
+                                         { try_connect(); });
+    }
+}
+
+void PresenterLink::follow(const std::string &path, EventLoop &event_loop,
+                           std::function<void(const Message &)> handler, std::function<void(bool)> on_connection)
+{
+    loop = &event_loop;
+    socket_path = path;
+    following = true;
+    message_handler = std::move(handler);
+    connection_handler = std::move(on_connection);
+
+    try_connect();
+    if (peer_fd < 0)
+        retry_timer_fd = loop->add_timer(RETRY_MS, RETRY_MS, [this]()
+                                         { try_connect(); });
+}
+
+void PresenterLink::try_connect()
+{
+    sockaddr_un address;
+    std::string error;
+    if (peer_fd >= 0 || !make_address(socket_path, address, error))
+        return;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return;
+    if (connect(fd, (const sockaddr *)&address, sizeof(address)) < 0)
+    {
+        ::close(fd);
+        return;
+    }
+
+    if (retry_timer_fd >= 0)
+    {
+        loop->remove_timer(retry_timer_fd);
+        retry_timer_fd = -1;
+    }
+    peer_fd = fd;
+    loop->add_fd(peer_fd, [this](uint32_t)
+                 { read_messages(); });
+    if (connection_handler)
+        connection_handler(true);
+}
+
+void PresenterLink::read_messages()
+{
+    char buffer[65536];
+    ssize_t count = read(peer_fd, buffer, sizeof(buffer));
+    if (count < 0 && (errno == EINTR || errno == EAGAIN))
+        return;
+    if (count <= 0)
+    {
+        drop_peer();
+        return;
+    }
+    inbox.append(buffer, count);
+
+    // Every whole message is handled; a partial one waits for the rest
+    size_t start = 0;
+    Message message;
+    while (start < inbox.size())
+    {
+        long used = decode(inbox, start, message);
+        if (used < 0)
+        {
+            drop_peer();
+            return;
+        }
+        if (used == 0)
+            break;
+        start += used;
+        message_handler(message);
+        if (peer_fd < 0)
+            return;
+    }
+    inbox.erase(0, start);
+}
+
+void PresenterLink::encode(const Message &message, std::string &out)
+{
+    char header[96];
+    int length = snprintf(header, sizeof(header), "%c %d %d %lld %zu\n", (char)message.kind, message.slide,
+                          message.element, (long long)message.value, message.text.size());
+    out.append(header, length);
+    out += message.text;
+}
+
+long PresenterLink::decode(const std::string &data, size_t start, Message &message)
+{
+    size_t newline = data.find('\n', start);
+    if (newline == std::string::npos)
+        return data.size() - start > 96 ? -1 : 0;
+
+    std::string header = data.substr(start, newline - start);
+    char kind;
+    long long value;
+    long text_length;
+    if (sscanf(header.c_str(), "%c %d %d %lld %ld", &kind, &message.slide, &message.element, &value,
+               &text_length) != 5 ||
+        text_length < 0 || text_length > MAX_TEXT)
+        return -1;
+    if (data.size() - newline - 1 < (size_t)text_length)
+        return 0;
+
+    message.kind = (Kind)kind;
+    message.value = value;
+    message.text.assign(data, newline + 1, text_length);
+    return newline + 1 + text_length - start;
+}
+
+void PresenterLink::close()
+{
+    if (!loop)
+        return;
+    if (retry_timer_fd >= 0)
+    {
+        loop->remove_timer(retry_timer_fd);
+        retry_timer_fd = -1;
+    }
+    // Not reported as a lost connection; the follower is quitting
+    following = false;
+    drop_peer();
+    if (server)
+    {
+        loop->remove_fd(server->joined_fd());
+        server->stop();
+        server.reset();
+        unlink(socket_path.c_str());
+    }
+    presenting = false;
+    loop = nullptr;
+}
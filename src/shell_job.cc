@@ -0,0 +1,315 @@
+#include "shell_job.hh"
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+ShellJob::ShellJob(const std::string &cmd)
+    : command(cmd), running(false), recorder(nullptr), session(nullptr), replay_source(nullptr),
+      replay_next(0), replay_speed(1.0), replay_timer_fd(-1)
+{
+}
+
+ShellJob::~ShellJob()
+{
+    if (session)
+        session->interrupt();
+    if (replay_timer_fd >= 0)
+        close(replay_timer_fd);
+}
+
+void ShellJob::start(const ShellJobOptions &options)
+{
+    start_time = std::chrono::steady_clock::now();
+
+    std::string error;
+    output.set_screen_rows(options.rows);
+    if (options.spill_output && !output.enable_spill(error))
+    {
+        output.append("[" + error + "; keeping only the most recent lines]\n");
+    }
+
+    if (options.replay)
+    {
+        start_replay(options.recorder ? options.recorder->find(command) : nullptr, options.replay_speed);
+        return;
+    }
+
+    winsize pty_size = {};
+    pty_size.ws_row = (unsigned short)options.rows;
+    pty_size.ws_col = (unsigned short)options.columns;
+    bool in_session = options.session && !options.session->is_busy();
+    if (in_session ? options.session->run(command, options.rows, options.columns, error)
+                   : process.start(command, error, options.use_pty ? &pty_size : nullptr))
+    {
+        running = true;
+        status = "Running...";
+        recorder = options.recorder;
+        session = in_session ? options.session : nullptr;
+    }
+    else
+    {
+        status = "Failed";
+        output.append("Error: " + error);
+        finish_time = std::chrono::steady_clock::now();
+    }
+}
+
+void ShellJob::start_replay(const CommandRecording *source, double speed)
+{
+    if (!source)
+    {
+        // Replay mode never falls back to running the command
+        status = "Not recorded";
+        output.append("[No recorded output for this command]");
+        finish_time = std::chrono::steady_clock::now();
+        return;
+    }
+
+    replay_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (replay_timer_fd < 0)
+    {
+        status = "Failed";
+        output.append("Error: could not create replay timer");
+        return;
+    }
+
+    replay_source = source;
+    replay_next = 0;
+    replay_speed = speed;
+    running = true;
+    status = "Replaying...";
+    replay_due();
+}
+
+bool ShellJob::replay_due()
+{
+    auto elapsed = std::chrono::steady_clock::now() - start_time;
+    double elapsed_ms = std::chrono::duration<double, std::milli>(elapsed).count();
+
+    // Play every chunk whose time has come, then sleep until the next one
+    while (replay_next <= replay_source->chunks.size())
+    {
+        bool at_end = replay_next == replay_source->chunks.size();
+        uint32_t ms = at_end ? replay_source->duration_ms : replay_source->chunks[replay_next].ms;
+        double due_ms = replay_speed > 0 ? ms / replay_speed : 0;
+
+        if (due_ms > elapsed_ms)
+        {
+            long wait_ns = static_cast<long>((due_ms - elapsed_ms) * 1000000.0) + 1;
+            itimerspec spec = {};
+            spec.it_value.tv_sec = wait_ns / 1000000000L;
+            spec.it_value.tv_nsec = wait_ns % 1000000000L;
+            timerfd_settime(replay_timer_fd, 0, &spec, nullptr);
+            return true;
+        }
+
+        if (at_end)
+        {
+            close(replay_timer_fd);
+            replay_timer_fd = -1;
+            finish(replay_source->status + ", replayed");
+            return false;
+        }
+        append(replay_source->chunks[replay_next].data);
+        replay_next++;
+    }
+    return false;
+}
+
+bool ShellJob::read_available()
+{
+    if (!running)
+        return false;
+
+    if (replay_source)
+    {
+        // Only the expiration needs consuming; replay_next holds the schedule
+        uint64_t expirations;
+        ssize_t ignored = read(replay_timer_fd, &expirations, sizeof(expirations));
+        (void)ignored;
+        return replay_due();
+    }
+
+    std::string chunk;
+    if (session)
+    {
+        std::string how;
+        bool open = session->read_output(chunk, how);
+        append(chunk);
+        if (!open)
+        {
+            session = nullptr;
+            finish(how);
+        }
+        return open;
+    }
+
+    bool open = process.read_available(chunk);
+    append(chunk);
+
+    if (!open)
+    {
+        finish(process.wait_status());
+    }
+    return open;
+}
+
+void ShellJob::append(const std::string &chunk)
+{
+    if (chunk.empty())
+        return;
+    parser.feed(chunk.data(), chunk.size(), output);
+    if (output_listener)
+        output_listener(chunk);
+
+    if (recorder)
+    {
+        auto elapsed = std::chrono::steady_clock::now() - start_time;
+        recording.chunks.push_back(
+            {static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()), chunk});
+    }
+}
+
+void ShellJob::finish(const std::string &how)
+{
+    running = false;
+    status = "Finished (" + how + ")";
+    finish_time = std::chrono::steady_clock::now();
+    if (output.line_count() == 0)
+    {
+        output.append("[No output]");
+    }
+    notify_end();
+
+    // Only runs that completed replace an earlier recording
+    if (recorder)
+    {
+        recording.duration_ms = static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(finish_time - start_time).count());
+        recording.status = how;
+        recorder->store(command, std::move(recording));
+        recorder = nullptr;
+    }
+}
+
+void ShellJob::stop()
+{
+    if (running)
+    {
+        // A session command is interrupted; the session itself lives on
+        if (session)
+            session->interrupt();
+        session = nullptr;
+        process.kill_group();
+        if (replay_timer_fd >= 0)
+        {
+            close(replay_timer_fd);
+            replay_timer_fd = -1;
+        }
+        running = false;
+        status = "Stopped";
+        finish_time = std::chrono::steady_clock::now();
+        notify_end();
+    }
+}
+
+void ShellJob::notify_end()
+{
+    if (end_listener)
+        end_listener(status);
+}
+
+void ShellJob::set_listener(std::function<void(const std::string &chunk)> on_output,
+                            std::function<void(const std::string &status)> on_end)
+{
+    output_listener = std::move(on_output);
+    end_listener = std::move(on_end);
+
+    // A prefetched job has already read some output, or even ended
+    std::string text = get_output_text();
+    if (!text.empty() && output_listener)
+        output_listener(text);
+    if (!running && !status.empty())
+        notify_end();
+}
+
+void ShellJob::start_mirror(int rows)
+{
+    start_time = std::chrono::steady_clock::now();
+    output.set_screen_rows(rows);
+    running = true;
+    status = "Running on the presenter...";
+}
+
+void ShellJob::mirror_output(const std::string &chunk)
+{
+    parser.feed(chunk.data(), chunk.size(), output);
+}
+
+void ShellJob::mirror_end(const std::string &final_status)
+{
+    running = false;
+    status = final_status;
+    finish_time = std::chrono::steady_clock::now();
+    if (output.line_count() == 0)
+    {
+        output.append("[No output]");
+    }
+}
+
+void ShellJob::resize(int rows, int columns)
+{
+    output.set_screen_rows(rows);
+    if (session)
+        session->resize(rows, columns);
+    else
+        process.resize(rows, columns);
+}
+
+int ShellJob::output_fd() const
+{
+    if (session)
+        return session->output_fd();
+    return replay_source ? replay_timer_fd : process.output_fd();
+}
+
+bool ShellJob::is_running() const
+{
+    return running;
+}
+
+const std::string &ShellJob::get_command() const
+{
+    return command;
+}
+
+const std::string &ShellJob::get_status() const
+{
+    return status;
+}
+
+OutputBuffer &ShellJob::get_output()
+{
+    return output;
+}
+
+std::string ShellJob::get_output_text()
+{
+    std::string text;
+    for (size_t line = output.first_line(); line < output.line_count(); ++line)
+    {
+        if (line > output.first_line())
+            text += '\n';
+        text.append(output.line(line));
+    }
+    return text;
+}
+
+std::chrono::steady_clock::time_point ShellJob::get_start_time() const
+{
+    return start_time;
+}
+
+std::chrono::steady_clock::time_point ShellJob::get_finish_time() const
+{
+    return finish_time;
+}
@@ -0,0 +1,374 @@
+#include "shell_pane_grid.hh"
+#include "event_loop.hh"
+#include "input_recorder.hh"
+#include <ncurses.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <unistd.h>
+
+namespace
+{
+    std::string format_elapsed(std::chrono::steady_clock::duration elapsed)
+    {
+        char text[32];
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        if (seconds < 60)
+            snprintf(text, sizeof(text), "%.1fs", seconds);
+        else
+            snprintf(text, sizeof(text), "%dm%02ds", (int)seconds / 60, (int)seconds % 60);
+        return text;
+    }
+
+    std::chrono::steady_clock::duration job_elapsed(const ShellJob &job)
+    {
+        auto end = job.is_running() ? std::chrono::steady_clock::now() : job.get_finish_time();
+        return end - job.get_start_time();
+    }
+}
+
+ShellPaneGrid::ShellPaneGrid(int screen_width, int screen_height)
+    : focused(0), elapsed_timer_fd(-1)
+{
+    compute_geometry(screen_width, screen_height);
+}
+
+void ShellPaneGrid::compute_geometry(int screen_width, int screen_height)
+{
+    area_x = 2;
+    area_y = 2;
+    area_width = std::max(screen_width - 4, 10);
+    area_height = std::max(screen_height - 4, 6);
+    layout_panes();
+}
+
+void ShellPaneGrid::layout_panes()
+{
+    // Near-square grid; two commands sit side by side. The first and last
+    // rows of the area hold the title and the key help.
+    int count = std::max((int)panes.size(), 1);
+    int columns = (int)std::ceil(std::sqrt((double)count));
+    int rows = (count + columns - 1) / columns;
+    int tile_width = area_width / columns;
+    int tile_height = (area_height - 2) / rows;
+
+    for (int i = 0; i < (int)panes.size(); ++i)
+    {
+        Pane &pane = panes[i];
+        int column = i % columns;
+        int row = i / columns;
+        pane.x = area_x + column * tile_width;
+        pane.y = area_y + 1 + row * tile_height;
+        pane.width = column == columns - 1 ? area_width - column * tile_width : tile_width;
+        pane.height = row == rows - 1 ? area_height - 2 - row * tile_height : tile_height;
+
+        // Border, then a status row, then the output
+        pane.view.set_area(pane.y + 2, pane.x + 1, pane.height - 3, pane.width - 2);
+        if (pane.job && pane.job->is_running())
+            pane.job->resize(pane.view.get_height(), pane.view.get_width());
+    }
+}
+
+void ShellPaneGrid::set_job_options(const ShellJobOptions &options)
+{
+    job_options = options;
+}
+
+void ShellPaneGrid::set_resize_handler(std::function<void()> handler)
+{
+    resize_handler = std::move(handler);
+}
+
+void ShellPaneGrid::relayout(int screen_width, int screen_height)
+{
+    compute_geometry(screen_width, screen_height);
+    draw_all();
+}
+
+void ShellPaneGrid::show(EventLoop &loop, const std::vector<std::string> &commands,
+                         std::vector<std::unique_ptr<ShellJob>> prefetched)
+{
+    panes.clear();
+    panes.resize(commands.size());
+    focused = 0;
+    layout_panes();
+
+    // Every command starts before any output is drawn
+    for (size_t i = 0; i < panes.size(); ++i)
+    {
+        if (i < prefetched.size())
+            panes[i].job = std::move(prefetched[i]);
+        if (!panes[i].job)
+            start_pane(panes[i], commands[i]);
+        else if (panes[i].job->is_running())
+            panes[i].job->resize(panes[i].view.get_height(), panes[i].view.get_width());
+        watch_pane(panes[i], loop);
+    }
+
+    update_elapsed(loop);
+    draw_all();
+    refresh();
+    loop.run_modal([this, &loop]()
+                   { handle_input(loop); });
+
+    if (elapsed_timer_fd >= 0)
+    {
+        loop.remove_timer(elapsed_timer_fd);
+        elapsed_timer_fd = -1;
+    }
+    for (auto &pane : panes)
+    {
+        if (pane.job->is_running())
+            loop.remove_fd(pane.job->output_fd());
+        pane.job->stop();
+    }
+    clear_area();
+    panes.clear();
+}
+
+void ShellPaneGrid::start_pane(Pane &pane, const std::string &command)
+{
+    // Each command's terminal is the size of its tile
+    ShellJobOptions options = job_options;
+    options.rows = pane.view.get_height();
+    options.columns = pane.view.get_width();
+    pane.job = std::make_unique<ShellJob>(command);
+    pane.job->start(options);
+}
+
+void ShellPaneGrid::watch_pane(Pane &pane, EventLoop &loop)
+{
+    pane.view.set_buffer(&pane.job->get_output());
+
+    if (pane.job->is_running())
+    {
+        loop.add_fd(pane.job->output_fd(), [this, &pane, &loop](uint32_t)
+                    { read_output(pane, loop); });
+    }
+}
+
+void ShellPaneGrid::read_output(Pane &pane, EventLoop &loop)
+{
+    int fd = pane.job->output_fd();
+    if (!pane.job->read_available())
+    {
+        loop.remove_fd(fd);
+        update_elapsed(loop);
+    }
+
+    // Only this pane's cells change
+    pane.view.update();
+    pane.view.draw(8);
+    draw_pane_status(pane);
+    draw_title();
+    refresh();
+}
+
+void ShellPaneGrid::update_elapsed(EventLoop &loop)
+{
+    bool any_running = std::any_of(panes.begin(), panes.end(), [](const Pane &pane)
+                                   { return pane.job->is_running(); });
+
+    if (any_running && elapsed_timer_fd < 0)
+    {
+        elapsed_timer_fd = loop.add_timer(100, 100, [this, &loop]()
+                                          {
+                                              update_elapsed(loop);
+                                              refresh();
+                                          });
+    }
+    else if (!any_running && elapsed_timer_fd >= 0)
+    {
+        loop.remove_timer(elapsed_timer_fd);
+        elapsed_timer_fd = -1;
+    }
+
+    for (const auto &pane : panes)
+    {
+        draw_pane_status(pane);
+    }
+    draw_title();
+}
+
+void ShellPaneGrid::draw_all()
+{
+    clear_area();
+    draw_title();
+
+    attron(COLOR_PAIR(1) | A_BOLD);
+    mvprintw(area_y + area_height - 1, area_x,
+             "[ ESC: Close | Tab: Next pane | ↑↓ PgUp/PgDn: Scroll | r: Re-run pane ]");
+    attroff(COLOR_PAIR(1) | A_BOLD);
+
+    for (int i = 0; i < (int)panes.size(); ++i)
+    {
+        draw_pane_frame(i);
+        draw_pane_status(panes[i]);
+        panes[i].view.draw(8);
+    }
+}
+
+void ShellPaneGrid::draw_title()
+{
+    // Overall time is the slowest command's time
+    int running = 0;
+    std::chrono::steady_clock::duration slowest(0);
+    for (const auto &pane : panes)
+    {
+        if (pane.job->is_running())
+            running++;
+        slowest = std::max(slowest, job_elapsed(*pane.job));
+    }
+
+    std::string title = "[ Run all: " + std::to_string(panes.size()) + " commands | " +
+                        (running ? std::to_string(running) + " running" : std::string("all done")) +
+                        " | " + format_elapsed(slowest) + " ]";
+
+    attron(COLOR_PAIR(0));
+    mvhline(area_y, area_x, ' ', area_width);
+    attroff(COLOR_PAIR(0));
+    attron(COLOR_PAIR(1) | A_BOLD);
+    mvaddnstr(area_y, area_x, title.c_str(), area_width);
+    attroff(COLOR_PAIR(1) | A_BOLD);
+}
+
+void ShellPaneGrid::draw_pane_frame(int index)
+{
+    const Pane &pane = panes[index];
+    int attrs = index == focused ? (COLOR_PAIR(4) | A_BOLD) : COLOR_PAIR(1);
+
+    attron(attrs);
+    mvhline(pane.y, pane.x, '-', pane.width);
+    mvhline(pane.y + pane.height - 1, pane.x, '-', pane.width);
+    mvvline(pane.y + 1, pane.x, '|', pane.height - 2);
+    mvvline(pane.y + 1, pane.x + pane.width - 1, '|', pane.height - 2);
+
+    std::string title = "[ $ " + pane.job->get_command() + " ]";
+    if ((int)title.length() > pane.width - 4)
+    {
+        title = title.substr(0, std::max(pane.width - 9, 0)) + "... ]";
+    }
+    mvaddnstr(pane.y, pane.x + 2, title.c_str(), pane.width - 4);
+    attroff(attrs);
+}
+
+void ShellPaneGrid::draw_pane_status(const Pane &pane)
+{
+    std::string status = pane.job->is_running() ? "Running" : pane.job->get_status();
+    status += " " + format_elapsed(job_elapsed(*pane.job));
+
+    attron(COLOR_PAIR(0));
+    mvhline(pane.y + 1, pane.x + 1, ' ', pane.width - 2);
+    attroff(COLOR_PAIR(0));
+
+    int status_color = pane.job->is_running() ? 4 : 7;
+    attron(COLOR_PAIR(status_color) | A_BOLD);
+    mvaddnstr(pane.y + 1, pane.x + 1, status.c_str(), pane.width - 2);
+    attroff(COLOR_PAIR(status_color) | A_BOLD);
+}
+
+void ShellPaneGrid::handle_input(EventLoop &loop)
+{
+    int ch;
+    nodelay(stdscr, TRUE);
+    while (!loop.is_stopped() && (ch = InputRecorder::instance().read_key()) != ERR)
+    {
+        if (!handle_key(ch, loop))
+        {
+            loop.stop();
+        }
+    }
+    nodelay(stdscr, FALSE);
+}
+
+bool ShellPaneGrid::handle_key(int ch, EventLoop &loop)
+{
+    if (panes.empty())
+        return false;
+
+    Pane &pane = panes[focused];
+    switch (ch)
+    {
+    case 27: // ESC closes the grid and kills whatever still runs
+    case 'q':
+    case 'Q':
+        return false;
+
+    case KEY_RESIZE:
+        if (resize_handler)
+        {
+            resize_handler();
+        }
+        else
+        {
+            relayout(COLS, LINES);
+            refresh();
+        }
+        return true;
+
+    case '\t':
+    case KEY_BTAB:
+    {
+        int previous = focused;
+        int count = (int)panes.size();
+        focused = (focused + (ch == '\t' ? 1 : count - 1)) % count;
+        draw_pane_frame(previous);
+        draw_pane_frame(focused);
+        refresh();
+        return true;
+    }
+
+    case 'r':
+        if (pane.job->is_running())
+        {
+            loop.remove_fd(pane.job->output_fd());
+        }
+        start_pane(pane, pane.job->get_command());
+        watch_pane(pane, loop);
+        update_elapsed(loop);
+        break;
+
+    case KEY_UP:
+        pane.view.scroll_up(1);
+        break;
+
+    case KEY_DOWN:
+        pane.view.scroll_down(1);
+        break;
+
+    case KEY_PPAGE:
+        pane.view.scroll_up(pane.view.get_height());
+        break;
+
+    case KEY_NPAGE:
+        pane.view.scroll_down(pane.view.get_height());
+        break;
+
+    case KEY_HOME:
+        pane.view.scroll_to_start();
+        break;
+
+    case KEY_END:
+        pane.view.scroll_to_end();
+        break;
+
+    default:
+        return true;
+    }
+
+    pane.view.draw(8);
+    draw_pane_status(pane);
+    refresh();
+    return true;
+}
+
+void ShellPaneGrid::clear_area()
+{
+    attron(COLOR_PAIR(0));
+    for (int i = 0; i < area_height; ++i)
+    {
+        mvhline(area_y + i, area_x, ' ', area_width);
+    }
+    attroff(COLOR_PAIR(0));
+}
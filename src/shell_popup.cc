@@ -1,30 +1,102 @@
 #include "shell_popup.hh"
+#include "event_loop.hh"
+#include "input_recorder.hh"
+#include <chrono>
 #include <ncurses.h>
-#include <sstream>
 #include <algorithm>
-#include <cstdio>
-#include <memory>
-#include <array>
+#include <unistd.h>
 
 ShellPopup::ShellPopup(int screen_width, int screen_height)
+{
+    compute_geometry(screen_width, screen_height);
+    prefetched = false;
+    mirroring = false;
+    search_prompt = false;
+    search_origin = 0;
+    match_line = OutputSearch::NOT_FOUND;
+    search_scanned = 0;
+}
+
+void ShellPopup::compute_geometry(int screen_width, int screen_height)
 {
     popup_width = std::min(screen_width - 4, 120);  // Max 120 chars wide
     popup_height = std::min(screen_height - 4, 30); // Max 30 lines high
     popup_x = (screen_width - popup_width) / 2;
     popup_y = (screen_height - popup_height) / 2;
-    scroll_offset = 0;
-    is_running = false;
+    view.set_area(popup_y + 4, popup_x + 2, popup_height - 6, popup_width - 6);
+}
+
+void ShellPopup::output_size(int screen_width, int screen_height, int &rows, int &columns)
+{
+    ShellPopup sizing(screen_width, screen_height);
+    rows = sizing.view.get_height();
+    columns = sizing.view.get_width();
 }
 
-void ShellPopup::show(const std::string &cmd)
+void ShellPopup::show(EventLoop &loop, const std::string &cmd, std::unique_ptr<ShellJob> prefetched_job)
 {
     command = cmd;
+    job = std::move(prefetched_job);
+    // Output that is still streaming in is as fresh as a new run
+    prefetched = job && !job->is_running();
     draw_popup_frame();
-    execute_command();
-    handle_input();
+
+    // Output streams in while the popup stays responsive; ESC stops the command
+    execute_command(loop);
+    loop.run_modal([this, &loop]()
+                   { handle_input(loop); });
+
+    if (job->is_running())
+        loop.remove_fd(job->output_fd());
+    job->stop();
     clear_popup_area();
 }
 
+void ShellPopup::set_job_options(const ShellJobOptions &options)
+{
+    job_options = options;
+}
+
+void ShellPopup::set_job_handler(std::function<void(ShellJob &)> handler)
+{
+    job_handler = std::move(handler);
+}
+
+void ShellPopup::show_mirror(std::unique_ptr<ShellJob> mirrored)
+{
+    job = std::move(mirrored);
+    command = job->get_command();
+    mirroring = true;
+    view.set_buffer(&job->get_output());
+    draw_popup_frame();
+    display_output();
+}
+
+void ShellPopup::update_mirror()
+{
+    view.update();
+    display_output();
+}
+
+ShellJob &ShellPopup::get_job()
+{
+    return *job;
+}
+
+void ShellPopup::set_resize_handler(std::function<void()> handler)
+{
+    resize_handler = std::move(handler);
+}
+
+void ShellPopup::relayout(int screen_width, int screen_height)
+{
+    compute_geometry(screen_width, screen_height);
+    if (job && job->is_running())
+        job->resize(view.get_height(), view.get_width());
+    draw_popup_frame();
+    display_output();
+}
+
 void ShellPopup::draw_popup_frame()
 {
     // Draw popup background
@@ -52,11 +124,8 @@ void ShellPopup::draw_popup_frame()
         mvprintw(popup_y + i, popup_x + popup_width - 1, "|");
     }
 
-    // Bottom border
-    mvhline(popup_y + popup_height - 1, popup_x, '-', popup_width);
-    mvprintw(popup_y + popup_height - 1, popup_x + 2, "[ ESC: Close | ↑↓: Scroll | PgUp/PgDn: Page ]");
-
     attroff(COLOR_PAIR(1) | A_BOLD);
+    draw_help_line();
 
     // Show command
     attron(COLOR_PAIR(7) | A_BOLD);
@@ -72,163 +141,334 @@ void ShellPopup::draw_popup_frame()
     attron(COLOR_PAIR(4));
     mvhline(popup_y + 3, popup_x + 1, '-', popup_width - 2);
     attroff(COLOR_PAIR(4));
+}
 
-    refresh();
+void ShellPopup::draw_help_line()
+{
+    // Bottom border, carrying the search prompt while it is open
+    attron(COLOR_PAIR(1) | A_BOLD);
+    mvhline(popup_y + popup_height - 1, popup_x, '-', popup_width);
+    if (search_prompt)
+    {
+        std::string prompt = "[ /" + search_input + "_ ]";
+        mvaddnstr(popup_y + popup_height - 1, popup_x + 2, prompt.c_str(), popup_width - 4);
+    }
+    else if (mirroring)
+    {
+        mvaddnstr(popup_y + popup_height - 1, popup_x + 2, "[ Following the presenter ]", popup_width - 4);
+    }
+    else
+    {
+        mvaddnstr(popup_y + popup_height - 1, popup_x + 2,
+                  "[ ESC: Close | ↑↓: Scroll | PgUp/PgDn: Page | /: Search n/N | r: Re-run ]", popup_width - 4);
+    }
+    attroff(COLOR_PAIR(1) | A_BOLD);
 }
 
-void ShellPopup::execute_command()
+void ShellPopup::execute_command(EventLoop &loop)
 {
-    // Show "Executing..." message
-    attron(COLOR_PAIR(4) | A_BOLD);
-    mvprintw(popup_y + 5, popup_x + 2, "Executing...");
-    attroff(COLOR_PAIR(4) | A_BOLD);
+    // A prefetched job may already be done, or still streaming
+    if (!job)
+    {
+        // The command's terminal is exactly the output area
+        ShellJobOptions options = job_options;
+        options.rows = view.get_height();
+        options.columns = view.get_width();
+        job = std::make_unique<ShellJob>(command);
+        job->start(options);
+    }
+    if (job_handler)
+        job_handler(*job);
+    if (job->is_running())
+    {
+        job->resize(view.get_height(), view.get_width());
+        loop.add_fd(job->output_fd(), [this, &loop](uint32_t)
+                    { read_output(loop); });
+    }
+
+    view.set_buffer(&job->get_output());
+    display_output();
     refresh();
+}
 
-    // Execute command
-    std::string output = execute_shell_command(command);
+void ShellPopup::rerun_command(EventLoop &loop)
+{
+    // stop() tells the listener the old run ended before a new one starts
+    if (job->is_running())
+    {
+        loop.remove_fd(job->output_fd());
+        job->stop();
+    }
+    job.reset();
+    prefetched = false;
+    match_line = OutputSearch::NOT_FOUND;
+    search_scanned = 0;
+    execute_command(loop);
+}
 
-    // Split into lines
-    std::istringstream iss(output);
-    std::string line;
-    output_lines.clear();
-    while (std::getline(iss, line))
+void ShellPopup::read_output(EventLoop &loop)
+{
+    int fd = job->output_fd();
+    if (!job->read_available())
     {
-        // Handle long lines - split them if necessary
-        if ((int)line.length() > popup_width - 6)
-        {
-            size_t pos = 0;
-            while (pos < line.length())
-            {
-                output_lines.push_back(line.substr(pos, popup_width - 6));
-                pos += popup_width - 6;
-            }
-        }
-        else
+        loop.remove_fd(fd);
+    }
+
+    view.update();
+    search_new_output();
+    display_output();
+    refresh();
+}
+
+void ShellPopup::search_new_output()
+{
+    // Until something matches, each batch of output is searched as it arrives
+    OutputBuffer &output = job->get_output();
+    size_t line_count = output.line_count();
+    if (search.is_active() && match_line == OutputSearch::NOT_FOUND)
+    {
+        size_t found = search.find_line(output, std::max(search_scanned, output.first_line()), line_count);
+        if (found != OutputSearch::NOT_FOUND)
         {
-            output_lines.push_back(line);
+            match_line = found;
+            view.show_line(found);
         }
     }
+    // The last line may still grow
+    search_scanned = line_count > 0 ? line_count - 1 : 0;
+}
 
-    if (output_lines.empty())
+void ShellPopup::run_search(size_t from, bool forward)
+{
+    OutputBuffer &output = job->get_output();
+    size_t first = output.first_line();
+    size_t line_count = output.line_count();
+    from = std::max(from, first);
+
+    match_line = OutputSearch::NOT_FOUND;
+    search_scanned = line_count > 0 ? line_count - 1 : 0;
+    if (!search.is_active())
+        return;
+
+    // Wrap around like less does
+    if (forward)
+    {
+        match_line = search.find_line(output, from, line_count);
+        if (match_line == OutputSearch::NOT_FOUND)
+            match_line = search.find_line(output, first, from);
+    }
+    else
     {
-        output_lines.push_back("[No output]");
+        match_line = search.find_line_backward(output, first, from);
+        if (match_line == OutputSearch::NOT_FOUND)
+            match_line = search.find_line_backward(output, from, line_count);
     }
+    if (match_line != OutputSearch::NOT_FOUND)
+        view.show_line(match_line);
+}
 
-    scroll_offset = 0;
+bool ShellPopup::handle_search_key(int ch)
+{
+    switch (ch)
+    {
+    case 27: // ESC drops the search and goes back to where it started
+        search_prompt = false;
+        search.set_pattern("");
+        view.set_highlight(nullptr);
+        match_line = OutputSearch::NOT_FOUND;
+        view.show_line(search_origin);
+        break;
+
+    case '\n':
+    case '\r':
+    case KEY_ENTER:
+        search_prompt = false;
+        break;
+
+    case KEY_BACKSPACE:
+    case 127:
+    case 8:
+        if (!search_input.empty())
+            search_input.pop_back();
+        break;
+
+    case KEY_RESIZE:
+        return false;
+
+    default:
+        // Printable ASCII and the bytes of UTF-8 characters
+        if (ch < 32 || ch > 255 || ch == 127)
+            return true;
+        search_input += (char)ch;
+        break;
+    }
+
+    if (ch != 27)
+    {
+        // Incremental: every edit searches again from where the prompt opened
+        search.set_pattern(search_input);
+        view.set_highlight(&search);
+        run_search(search_origin, true);
+    }
     display_output();
+    refresh();
+    return true;
 }
 
 void ShellPopup::display_output()
 {
-    // Clear output area
+    view.draw(8);
+    draw_help_line();
+
+    // The scroll arrows sit right of the text
     attron(COLOR_PAIR(0));
-    for (int i = 4; i < popup_height - 2; ++i)
-    {
-        for (int j = popup_x + 1; j < popup_x + popup_width - 1; ++j)
-        {
-            mvaddch(popup_y + i, j, ' ');
-        }
-    }
+    mvaddch(popup_y + 4, popup_x + popup_width - 3, ' ');
+    mvaddch(popup_y + popup_height - 3, popup_x + popup_width - 3, ' ');
     attroff(COLOR_PAIR(0));
 
-    // Calculate display area
-    int display_lines = popup_height - 6; // Available lines for output
-    int start_line = scroll_offset;
-    int end_line = std::min(start_line + display_lines, (int)output_lines.size());
-
-    // Display output lines
-    attron(COLOR_PAIR(8));
-    for (int i = start_line; i < end_line; ++i)
+    // Command status on the left of the info row
+    attron(COLOR_PAIR(0));
+    mvhline(popup_y + 1, popup_x + 1, ' ', popup_width - 2);
+    attroff(COLOR_PAIR(0));
+    std::string status = job->get_status();
+    if (prefetched && !job->is_running())
+    {
+        // Prefetched output can be old; say how old
+        auto age = std::chrono::duration_cast<std::chrono::seconds>(
+                       std::chrono::steady_clock::now() - job->get_finish_time())
+                       .count();
+        status += " - prefetched " + (age < 60 ? std::to_string(age) + "s" : std::to_string(age / 60) + "m") +
+                  " ago, r: re-run";
+    }
+    if (search.is_active())
     {
-        int display_row = popup_y + 4 + (i - start_line);
-        mvprintw(display_row, popup_x + 2, "%s", output_lines[i].c_str());
+        status += " | /" + search.get_pattern() + ": " +
+                  (match_line == OutputSearch::NOT_FOUND ? std::string("not found")
+                                                         : "line " + std::to_string(match_line + 1));
     }
-    attroff(COLOR_PAIR(8));
+    int status_color = job->is_running() ? 4 : 7;
+    attron(COLOR_PAIR(status_color) | A_BOLD);
+    mvprintw(popup_y + 1, popup_x + 2, "%s", status.c_str());
+    attroff(COLOR_PAIR(status_color) | A_BOLD);
 
     // Show scroll indicator if needed
-    if ((int)output_lines.size() > display_lines)
+    bool more_above = view.more_above();
+    bool more_below = view.more_below();
+    if (more_above || more_below)
     {
         attron(COLOR_PAIR(4) | A_BOLD);
 
-        // Calculate scroll info
-        int displayed_end = std::min(start_line + display_lines, (int)output_lines.size());
-        std::string scroll_info = "Lines " + std::to_string(start_line + 1) +
-                                  "-" + std::to_string(displayed_end) +
-                                  " of " + std::to_string(output_lines.size());
+        std::string scroll_info = "Lines " + std::to_string(view.get_top_line() + 1) +
+                                  "-" + std::to_string(view.get_end_line()) +
+                                  " of " + std::to_string(job->get_output().line_count());
 
         // Show scroll info in top right of popup
         mvprintw(popup_y + 1, popup_x + popup_width - scroll_info.length() - 3,
                  "%s", scroll_info.c_str());
 
         // Show scroll arrows if applicable
-        if (start_line > 0)
+        if (more_above)
         {
             mvprintw(popup_y + 4, popup_x + popup_width - 3, "↑");
         }
-        if (displayed_end < (int)output_lines.size())
+        if (more_below)
         {
             mvprintw(popup_y + popup_height - 3, popup_x + popup_width - 3, "↓");
         }
 
         attroff(COLOR_PAIR(4) | A_BOLD);
     }
-
-    refresh();
 }
 
-void ShellPopup::handle_input()
+void ShellPopup::handle_input(EventLoop &loop)
 {
-    int display_lines = popup_height - 6;
     int ch;
+    nodelay(stdscr, TRUE);
+    while (!loop.is_stopped() && (ch = InputRecorder::instance().read_key()) != ERR)
+    {
+        if (!handle_key(ch, loop))
+        {
+            loop.stop();
+        }
+    }
+    nodelay(stdscr, FALSE);
+}
 
-    while ((ch = getch()) != 27)
-    { // ESC to close
-        switch (ch)
+bool ShellPopup::handle_key(int ch, EventLoop &loop)
+{
+    if (search_prompt && handle_search_key(ch))
+        return true;
+
+    switch (ch)
+    {
+    case 27: // ESC closes the popup and kills the command if it still runs
+    case 'q':
+    case 'Q':
+        return false;
+
+    case KEY_RESIZE:
+        if (resize_handler)
         {
-        case KEY_UP:
-            if (scroll_offset > 0)
-            {
-                scroll_offset--;
-                display_output();
-            }
-            break;
-
-        case KEY_DOWN:
-            if (scroll_offset + display_lines < (int)output_lines.size())
-            {
-                scroll_offset++;
-                display_output();
-            }
-            break;
-
-        case KEY_PPAGE: // Page Up
-            scroll_offset = std::max(0, scroll_offset - display_lines);
-            display_output();
-            break;
-
-        case KEY_NPAGE: // Page Down
-            scroll_offset = std::min((int)output_lines.size() - display_lines,
-                                     scroll_offset + display_lines);
-            if (scroll_offset < 0)
-                scroll_offset = 0;
-            display_output();
-            break;
-
-        case KEY_HOME:
-            scroll_offset = 0;
-            display_output();
-            break;
-
-        case KEY_END:
-            scroll_offset = std::max(0, (int)output_lines.size() - display_lines);
-            display_output();
-            break;
-
-        case 'q':
-        case 'Q':
-            return; // Also allow 'q' to quit
+            resize_handler();
         }
+        else
+        {
+            relayout(COLS, LINES);
+            refresh();
+        }
+        return true;
+
+    case KEY_UP:
+        view.scroll_up(1);
+        break;
+
+    case KEY_DOWN:
+        view.scroll_down(1);
+        break;
+
+    case KEY_PPAGE: // Page Up
+        view.scroll_up(view.get_height());
+        break;
+
+    case KEY_NPAGE: // Page Down
+        view.scroll_down(view.get_height());
+        break;
+
+    case KEY_HOME:
+        view.scroll_to_start();
+        break;
+
+    case KEY_END:
+        view.scroll_to_end();
+        break;
+
+    case 'r':
+        rerun_command(loop);
+        return true;
+
+    case '/':
+        search_prompt = true;
+        search_input.clear();
+        search_origin = view.get_top_line();
+        break;
+
+    case 'n':
+    case 'N':
+        if (!search.is_active())
+            return true;
+        if (ch == 'n')
+            run_search(match_line == OutputSearch::NOT_FOUND ? view.get_top_line() : match_line + 1, true);
+        else
+            run_search(match_line == OutputSearch::NOT_FOUND ? view.get_top_line() : match_line, false);
+        break;
+
+    default:
+        return true;
     }
+
+    display_output();
+    refresh();
+    return true;
 }
 
 void ShellPopup::clear_popup_area()
@@ -245,28 +485,3 @@ void ShellPopup::clear_popup_area()
     attroff(COLOR_PAIR(0));
     refresh();
 }
-
-std::string ShellPopup::execute_shell_command(const std::string &command)
-{
-    std::array<char, 128> buffer;
-    std::string result;
-
-    FILE *pipe_raw = popen(command.c_str(), "r");
-    if (!pipe_raw)
-        return "Error: Could not execute command";
-
-    std::unique_ptr<FILE, int (*)(FILE *)> pipe(pipe_raw, pclose);
-
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr)
-    {
-        result += buffer.data();
-    }
-
-    // Remove trailing newline if present
-    if (!result.empty() && result.back() == '\n')
-    {
-        result.pop_back();
-    }
-
-    return result;
-}
\ No newline at end of file
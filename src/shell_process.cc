@@ -0,0 +1,260 @@
+#include "shell_process.hh"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <pty.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    // Without pidfds, how often a shell that closed its output is checked on
+    const int EXIT_POLL_MS = 100;
+
+    void attach_control_fd(int control_fd)
+    {
+        if (control_fd < 0)
+            return;
+        if (control_fd == 3)
+            fcntl(3, F_SETFD, 0);
+        else
+            dup2(control_fd, 3);
+    }
+}
+
+ShellProcess::ShellProcess() : pid(-1), read_fd(-1), watch_fd(-1), exit_fd(-1), exit_status(0), on_pty(false)
+{
+}
+
+ShellProcess::~ShellProcess()
+{
+    kill_group();
+}
+
+bool ShellProcess::start(const std::string &command, std::string &error, const winsize *pty_size,
+                         int control_fd)
+{
+    if (pty_size)
+        return start_pty(command, error, *pty_size, control_fd);
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0)
+    {
+        error = std::string("Could not create pipe: ") + strerror(errno);
+        return false;
+    }
+
+    pid = fork();
+    if (pid < 0)
+    {
+        error = std::string("Could not fork: ") + strerror(errno);
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        // Own process group so one kill() reaches everything the command spawns
+        setpgid(0, 0);
+
+        // Keep the command away from the presenter's keyboard and screen
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd >= 0)
+            dup2(null_fd, STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        attach_control_fd(control_fd);
+
+        execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char *>(nullptr));
+        _exit(127);
+    }
+
+    // Also set from the parent so the group exists before we might signal it
+    setpgid(pid, pid);
+    close(fds[1]);
+    read_fd = fds[0];
+    fcntl(read_fd, F_SETFL, fcntl(read_fd, F_GETFL) | O_NONBLOCK);
+    return watch_output(error);
+}
+
+bool ShellProcess::start_pty(const std::string &command, std::string &error, const winsize &size,
+                             int control_fd)
+{
+    int master_fd = -1;
+    winsize pty_size = size;
+    pid = forkpty(&master_fd, nullptr, nullptr, &pty_size);
+    if (pid < 0)
+    {
+        error = std::string("Could not create pseudo-terminal: ") + strerror(errno);
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        // forkpty made us a session leader, and so a process group leader.
+        // stdin stays on the pty: nothing types there, but full-screen tools
+        // want a terminal on every standard stream.
+        attach_control_fd(control_fd);
+        execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char *>(nullptr));
+        _exit(127);
+    }
+
+    on_pty = true;
+    read_fd = master_fd;
+    fcntl(read_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(read_fd, F_SETFL, fcntl(read_fd, F_GETFL) | O_NONBLOCK);
+    return watch_output(error);
+}
+
+bool ShellProcess::watch_output(std::string &error)
+{
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    watch_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (watch_fd >= 0 && epoll_ctl(watch_fd, EPOLL_CTL_ADD, read_fd, &event) == 0)
+        return true;
+
+    // Nothing to wait on: the command is not left running unseen
+    error = std::string("Could not watch the command's output: ") + strerror(errno);
+    kill_group();
+    close_watch();
+    return false;
+}
+
+int ShellProcess::output_fd() const
+{
+    return watch_fd;
+}
+
+bool ShellProcess::read_available(std::string &output)
+{
+    char buffer[4096];
+    while (read_fd >= 0)
+    {
+        ssize_t count = read(read_fd, buffer, sizeof(buffer));
+        if (count > 0)
+        {
+            output.append(buffer, count);
+            continue;
+        }
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+
+        // A pty reports EIO rather than EOF once the command's side is closed
+        close_output();
+    }
+    return !reap_without_blocking();
+}
+
+bool ShellProcess::reap_without_blocking()
+{
+    if (pid <= 0)
+        return true;
+
+    if (exit_fd >= 0)
+    {
+        // A polling timer has to be read, or it stays readable; a pidfd
+        // cannot be read and is left alone by this
+        uint64_t expirations;
+        ssize_t ignored = read(exit_fd, &expirations, sizeof(expirations));
+        (void)ignored;
+    }
+
+    int status = 0;
+    pid_t reaped = waitpid(pid, &status, WNOHANG);
+    if (reaped == 0)
+    {
+        // Still running with its output closed: wake up when it exits
+        if (exit_fd < 0)
+        {
+            exit_fd = (int)syscall(SYS_pidfd_open, pid, 0);
+            if (exit_fd < 0)
+            {
+                exit_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+                itimerspec spec = {};
+                spec.it_value.tv_nsec = EXIT_POLL_MS * 1000000L;
+                spec.it_interval = spec.it_value;
+                timerfd_settime(exit_fd, 0, &spec, nullptr);
+            }
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            epoll_ctl(watch_fd, EPOLL_CTL_ADD, exit_fd, &event);
+        }
+        return false;
+    }
+
+    exit_status = reaped == pid ? status : 0;
+    pid = -1;
+    close_watch();
+    return true;
+}
+
+void ShellProcess::resize(int rows, int columns)
+{
+    if (!on_pty || read_fd < 0)
+        return;
+    winsize size = {};
+    size.ws_row = (unsigned short)rows;
+    size.ws_col = (unsigned short)columns;
+    ioctl(read_fd, TIOCSWINSZ, &size);
+}
+
+void ShellProcess::signal_group(int signal_number)
+{
+    if (pid > 0)
+        kill(-pid, signal_number);
+}
+
+void ShellProcess::kill_group()
+{
+    close_output();
+    if (pid > 0)
+    {
+        kill(-pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        pid = -1;
+    }
+    close_watch();
+}
+
+std::string ShellProcess::wait_status()
+{
+    if (WIFSIGNALED(exit_status))
+        return "killed by signal " + std::to_string(WTERMSIG(exit_status));
+    return "exit " + std::to_string(WEXITSTATUS(exit_status));
+}
+
+bool ShellProcess::is_running() const
+{
+    return pid > 0;
+}
+
+void ShellProcess::close_output()
+{
+    if (read_fd >= 0)
+    {
+        close(read_fd);
+        read_fd = -1;
+    }
+}
+
+void ShellProcess::close_watch()
+{
+    if (exit_fd >= 0)
+    {
+        close(exit_fd);
+        exit_fd = -1;
+    }
+    if (watch_fd >= 0)
+    {
+        close(watch_fd);
+        watch_fd = -1;
+    }
+}
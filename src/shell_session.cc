@@ -0,0 +1,218 @@
+#include "shell_session.hh"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <random>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    // Reads "nonce", the command's lines and "nonce" again from fd 3, runs
+    // the command in this shell and reports its status. The INT trap keeps
+    // the shell alive when ESC interrupts a command; commands still get the
+    // default action because trapped signals are reset on exec.
+    const char *WORKER_SCRIPT =
+        "trap : INT\n"
+        "while IFS= read -r __mdslides_nonce <&3; do\n"
+        "  __mdslides_command=\n"
+        "  while IFS= read -r __mdslides_line <&3 && [ \"$__mdslides_line\" != \"$__mdslides_nonce\" ]; do\n"
+        "    __mdslides_command=\"$__mdslides_command$__mdslides_line\n\"\n"
+        "  done\n"
+        "  eval \"$__mdslides_command\" 3<&-\n"
+        "  printf '\\033]mdslides;%s;%d\\007' \"$__mdslides_nonce\" \"$?\"\n"
+        "done\n";
+
+    const int INTERRUPT_WAIT_MS = 1000;
+
+    std::string make_nonce()
+    {
+        static std::mt19937_64 generator(std::random_device{}());
+        char text[32];
+        snprintf(text, sizeof(text), "%016llx", (unsigned long long)generator());
+        return text;
+    }
+}
+
+ShellSession::ShellSession() : control_fd(-1), use_pty(true), busy(false)
+{
+}
+
+ShellSession::~ShellSession()
+{
+    end_session();
+}
+
+void ShellSession::set_use_pty(bool enabled)
+{
+    use_pty = enabled;
+}
+
+bool ShellSession::start(int rows, int columns, std::string &error)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+    {
+        error = std::string("Could not create session socket: ") + strerror(errno);
+        return false;
+    }
+
+    winsize size = {};
+    size.ws_row = (unsigned short)rows;
+    size.ws_col = (unsigned short)columns;
+    bool started = process.start(WORKER_SCRIPT, error, use_pty ? &size : nullptr, fds[1]);
+    close(fds[1]);
+    if (!started)
+    {
+        close(fds[0]);
+        return false;
+    }
+    control_fd = fds[0];
+    return true;
+}
+
+void ShellSession::end_session()
+{
+    process.kill_group();
+    if (control_fd >= 0)
+    {
+        close(control_fd);
+        control_fd = -1;
+    }
+    busy = false;
+    pending.clear();
+}
+
+bool ShellSession::run(const std::string &command, int rows, int columns, std::string &error)
+{
+    if (busy)
+    {
+        error = "The shell session is busy";
+        return false;
+    }
+    if (!process.is_running() && !start(rows, columns, error))
+        return false;
+    process.resize(rows, columns);
+
+    std::string nonce = make_nonce();
+    std::string message = nonce + "\n" + command;
+    if (message.back() != '\n')
+        message += '\n';
+    message += nonce + "\n";
+
+    // The shell may have exited since the last command; start over once
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        if (send(control_fd, message.data(), message.size(), MSG_NOSIGNAL) == (ssize_t)message.size())
+        {
+            marker = "\033]mdslides;" + nonce + ";";
+            busy = true;
+            return true;
+        }
+        end_session();
+        if (!start(rows, columns, error))
+            return false;
+    }
+    error = "Could not send the command to the shell session";
+    return false;
+}
+
+int ShellSession::output_fd() const
+{
+    return process.output_fd();
+}
+
+size_t ShellSession::partial_marker_length() const
+{
+    // Longest tail of pending that the marker could continue
+    size_t longest = std::min(pending.size(), marker.size() - 1);
+    for (size_t length = longest; length > 0; --length)
+    {
+        if (pending.compare(pending.size() - length, length, marker, 0, length) == 0)
+            return length;
+    }
+    return 0;
+}
+
+bool ShellSession::read_output(std::string &output, std::string &how)
+{
+    if (!busy)
+        return false;
+
+    bool open = process.read_available(pending);
+
+    size_t start = pending.find(marker);
+    if (start != std::string::npos)
+    {
+        size_t end = pending.find('\007', start);
+        if (end != std::string::npos)
+        {
+            output.append(pending, 0, start);
+            how = "exit " + pending.substr(start + marker.size(), end - start - marker.size());
+            // Anything after the marker came from background jobs
+            pending.erase(0, end + 1);
+            busy = false;
+            return false;
+        }
+        output.append(pending, 0, start);
+        pending.erase(0, start);
+    }
+    else
+    {
+        size_t keep = partial_marker_length();
+        output.append(pending, 0, pending.size() - keep);
+        pending.erase(0, pending.size() - keep);
+    }
+
+    if (!open)
+    {
+        // The command ended the shell itself, e.g. with exit
+        output += pending;
+        how = process.wait_status() + ", session restarts";
+        end_session();
+        return false;
+    }
+    return true;
+}
+
+void ShellSession::interrupt()
+{
+    if (!busy)
+        return;
+
+    process.signal_group(SIGINT);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(INTERRUPT_WAIT_MS);
+    std::string discarded, how;
+    while (busy)
+    {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             deadline - std::chrono::steady_clock::now())
+                             .count();
+        if (remaining <= 0)
+            break;
+
+        pollfd poll_fd = {process.output_fd(), POLLIN, 0};
+        if (poll(&poll_fd, 1, (int)remaining) < 0 && errno != EINTR)
+            break;
+        read_output(discarded, how);
+        discarded.clear();
+    }
+
+    // Still running: the shell and its state go, the next command starts afresh
+    if (busy)
+        end_session();
+}
+
+void ShellSession::resize(int rows, int columns)
+{
+    process.resize(rows, columns);
+}
+
+bool ShellSession::is_busy() const
+{
+    return busy;
+}
@@ -1,8 +1,11 @@
 #include "slide_element.hh"
+#include "phase_profiler.hh"
+#include <algorithm>
 
 void SlideCollection::add_slide(const std::vector<SlideElement> &slide)
 {
     slides.push_back(slide);
+    layout_widths.push_back(0); // not laid out for any screen yet
 }
 
 std::vector<SlideElement> &SlideCollection::get_slide(int index)
@@ -28,4 +31,21 @@ bool SlideCollection::is_empty() const
 void SlideCollection::clear()
 {
     slides.clear();
+    layout_widths.clear();
+}
+
+void SlideCollection::ensure_layout(int index, int screen_width)
+{
+    if (layout_widths[index] == screen_width)
+        return;
+
+    ScopedPhase timing(Phase::LAYOUT);
+    for (auto &element : slides[index])
+    {
+        if (element.type == ElementType::HEADER1)
+        {
+            element.x = std::max((screen_width - (int)element.content.length()) / 2, 2);
+        }
+    }
+    layout_widths[index] = screen_width;
 }
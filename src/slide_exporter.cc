@@ -0,0 +1,324 @@
+#include "slide_exporter.hh"
+#include "phase_profiler.hh"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <cwchar>
+#include <thread>
+
+namespace
+{
+    const int PAIR_COUNT = 10;
+
+    // Bytes in the UTF-8 sequence led by c; stray continuation bytes count as one
+    int sequence_length(unsigned char c)
+    {
+        if (c >= 0xf0 && c < 0xf8)
+            return 4;
+        if (c >= 0xe0)
+            return c < 0xf0 ? 3 : 1;
+        if (c >= 0xc0)
+            return 2;
+        return 1;
+    }
+
+    wchar_t decode(const char *text, int length)
+    {
+        static const unsigned char lead_masks[] = {0, 0x7f, 0x1f, 0x0f, 0x07};
+        wchar_t code = (unsigned char)text[0] & lead_masks[length];
+        for (int i = 1; i < length; ++i)
+        {
+            code = (code << 6) | ((unsigned char)text[i] & 0x3f);
+        }
+        return code;
+    }
+
+    void append_color(std::string &out, int value, bool background)
+    {
+        char code[32];
+        if (value & THEME_RGB)
+            snprintf(code, sizeof(code), ";%d;2;%d;%d;%d", background ? 48 : 38, (value >> 16) & 0xff,
+                     (value >> 8) & 0xff, value & 0xff);
+        else if (value < 8)
+            snprintf(code, sizeof(code), ";%d", (background ? 40 : 30) + value);
+        else if (value < 16)
+            snprintf(code, sizeof(code), ";%d", (background ? 100 : 90) + value - 8);
+        else
+            snprintf(code, sizeof(code), ";%d;5;%d", background ? 48 : 38, value);
+        out += code;
+    }
+
+    std::string css_color(int value)
+    {
+        char color[8];
+        snprintf(color, sizeof(color), "#%06x", ThemeManager::rgb_of_color(value));
+        return color;
+    }
+
+    void append_escaped(std::string &out, const char *text, int length)
+    {
+        for (int i = 0; i < length; ++i)
+        {
+            switch (text[i])
+            {
+            case '&':
+                out += "&amp;";
+                break;
+            case '<':
+                out += "&lt;";
+                break;
+            case '>':
+                out += "&gt;";
+                break;
+            default:
+                out += text[i];
+            }
+        }
+    }
+
+    std::string deck_title(const std::vector<SlideElement> &elements)
+    {
+        for (const auto &element : elements)
+        {
+            if (element.type == ElementType::HEADER1 || element.type == ElementType::HEADER2 ||
+                element.type == ElementType::HEADER3)
+                return element.content;
+        }
+        return "Slides";
+    }
+}
+
+SlideExporter::SlideExporter(ExportFormat format, int width, const ThemeConfig &theme)
+    : format(format), width(width), theme(theme)
+{
+}
+
+bool SlideExporter::parse_format(const std::string &name, ExportFormat &format)
+{
+    if (name == "ansi")
+        format = ExportFormat::ANSI;
+    else if (name == "txt")
+        format = ExportFormat::TEXT;
+    else if (name == "html")
+        format = ExportFormat::HTML;
+    else
+        return false;
+    return true;
+}
+
+bool SlideExporter::write(SlideCollection &slides, FILE *out, std::string &error) const
+{
+    // Workers take the next slide until none are left; each slide is laid
+    // out and rendered by one worker only
+    int count = slides.get_slide_count();
+    std::vector<std::string> rendered(count);
+    std::atomic<int> next(0);
+    auto work = [&]()
+    {
+        for (int i = next++; i < count; i = next++)
+        {
+            ScopedPhase timing(Phase::EXPORT_SLIDE);
+            slides.ensure_layout(i, width);
+            rendered[i] = render_slide(slides.get_slide(i));
+        }
+    };
+
+    int workers = std::min(count, (int)std::max(std::thread::hardware_concurrency(), 1u));
+    std::vector<std::thread> threads;
+    for (int i = 1; i < workers; ++i)
+    {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    if (format == ExportFormat::HTML)
+    {
+        std::string header = html_header(count > 0 ? deck_title(slides.get_slide(0)) : "Slides");
+        fwrite(header.data(), 1, header.size(), out);
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        if (format == ExportFormat::HTML)
+            fprintf(out, "<section id=\"slide-%d\"><pre>", i + 1);
+        else if (i > 0)
+            fputs("\f\n", out);
+        fwrite(rendered[i].data(), 1, rendered[i].size(), out);
+        if (format == ExportFormat::HTML)
+            fputs("</pre></section>\n", out);
+    }
+    if (format == ExportFormat::HTML)
+        fputs("</body>\n</html>\n", out);
+
+    if (fflush(out) != 0 || ferror(out))
+    {
+        error = std::string("Cannot write the export: ") + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+std::string SlideExporter::render_slide(const std::vector<SlideElement> &elements) const
+{
+    // Speaker notes stay out of handouts, as they stay off the screen
+    auto exported = [](const SlideElement &element)
+    { return element.type != ElementType::NOTE && element.y >= 0; };
+
+    int rows = 1;
+    for (const auto &element : elements)
+    {
+        if (exported(element))
+            rows = std::max(rows, element.y + 1);
+    }
+    std::vector<Cell> grid(rows * width);
+    for (const auto &element : elements)
+    {
+        if (exported(element))
+            put_element(element, grid);
+    }
+
+    std::string out;
+    out.reserve(grid.size() * (format == ExportFormat::TEXT ? 1 : 2));
+    const Cell blank;
+    for (int row = 0; row < rows; ++row)
+    {
+        const Cell *cells = &grid[row * width];
+        // ANSI rows are painted across the full width, in the theme's background
+        int end = width;
+        if (format != ExportFormat::ANSI)
+        {
+            while (end > 0 && !cells[end - 1].text)
+                end--;
+        }
+
+        const Cell *style = &blank;
+        if (format == ExportFormat::ANSI)
+            append_style(out, blank);
+        for (int column = 0; column < end; ++column)
+        {
+            const Cell &cell = cells[column];
+            if (cell.text && cell.length == 0)
+                continue;
+            if (format != ExportFormat::TEXT &&
+                (cell.pair != style->pair || cell.bold != style->bold || cell.dim != style->dim))
+            {
+                if (format == ExportFormat::HTML && style != &blank)
+                    out += "</span>";
+                if (format == ExportFormat::ANSI || cell.pair != 0 || cell.bold || cell.dim)
+                    append_style(out, cell);
+                style = cell.pair != 0 || cell.bold || cell.dim ? &cell : &blank;
+            }
+
+            if (!cell.text)
+                out += ' ';
+            else if (format == ExportFormat::HTML)
+                append_escaped(out, cell.text, cell.length);
+            else
+                out.append(cell.text, cell.length);
+        }
+        if (format == ExportFormat::HTML && style != &blank)
+            out += "</span>";
+        out += format == ExportFormat::ANSI ? "\x1b[0m\n" : "\n";
+    }
+    return out;
+}
+
+void SlideExporter::put_element(const SlideElement &element, std::vector<Cell> &grid) const
+{
+    Cell style;
+    style.pair = (uint8_t)std::min(std::max(element.color_pair, 0), PAIR_COUNT - 1);
+    style.bold = element.is_bold;
+    style.dim = element.type == ElementType::SHELL_OUTPUT && !element.executed;
+
+    Cell *row = &grid[element.y * width];
+    Cell *previous = nullptr;
+    const std::string &text = element.content;
+    int column = std::max(element.x, 0);
+    for (size_t i = 0; i < text.size() && column < width;)
+    {
+        int length = std::min<int>(sequence_length(text[i]), text.size() - i);
+        const char *bytes = text.data() + i;
+        i += length;
+        if ((unsigned char)bytes[0] < ' ')
+            continue;
+
+        int columns = length == 1 ? 1 : wcwidth(decode(bytes, length));
+        if (columns == 0 && previous && previous->text + previous->length == bytes)
+        {
+            // Combining marks stay with the character they follow
+            previous->length += length;
+            continue;
+        }
+        columns = columns == 2 ? 2 : 1;
+        if (column + columns > width)
+            break;
+
+        Cell &cell = row[column];
+        cell = style;
+        cell.text = bytes;
+        cell.length = (uint8_t)length;
+        if (columns == 2)
+        {
+            row[column + 1] = style;
+            row[column + 1].text = bytes;
+        }
+        previous = &cell;
+        column += columns;
+    }
+}
+
+void SlideExporter::append_style(std::string &out, const Cell &cell) const
+{
+    if (format == ExportFormat::HTML)
+    {
+        out += "<span class=\"p" + std::to_string(cell.pair);
+        if (cell.bold)
+            out += " b";
+        if (cell.dim)
+            out += " d";
+        out += "\">";
+        return;
+    }
+
+    int foreground, background;
+    ThemeManager::pair_colors(theme, cell.pair, foreground, background);
+    out += "\x1b[0";
+    if (cell.bold)
+        out += ";1";
+    if (cell.dim)
+        out += ";2";
+    append_color(out, foreground, false);
+    append_color(out, background, true);
+    out += 'm';
+}
+
+std::string SlideExporter::html_header(const std::string &title) const
+{
+    int foreground, background;
+    ThemeManager::pair_colors(theme, 0, foreground, background);
+    std::string html = "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>";
+    append_escaped(html, title.data(), title.size());
+    html += "</title>\n<style>\n"
+            "body { margin: 2em; background: #808080; }\n"
+            "section { margin: 0 auto 2em; width: max-content; break-after: page; }\n"
+            "pre { margin: 0; padding: 1em 1ch; font: 14px/1.3 monospace; width: " +
+            std::to_string(width) + "ch; color: " + css_color(foreground) +
+            "; background: " + css_color(background) + "; }\n"
+            ".b { font-weight: bold; }\n"
+            ".d { opacity: 0.6; }\n";
+    for (int pair = 1; pair < PAIR_COUNT; ++pair)
+    {
+        int pair_foreground, pair_background;
+        ThemeManager::pair_colors(theme, pair, pair_foreground, pair_background);
+        html += ".p" + std::to_string(pair) + " { color: " + css_color(pair_foreground) + ";";
+        if (pair_background != background)
+            html += " background: " + css_color(pair_background) + ";";
+        html += " }\n";
+    }
+    html += "</style>\n</head>\n<body>\n";
+    return html;
+}
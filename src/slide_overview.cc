@@ -0,0 +1,293 @@
+#include "slide_overview.hh"
+#include "event_loop.hh"
+#include "input_recorder.hh"
+#include <ncurses.h>
+#include <algorithm>
+#include <string>
+#include <unistd.h>
+
+SlideOverview::SlideOverview()
+    : slides(nullptr), selected(0), first_row(0), chosen(-1), area_x(0), area_y(0), area_width(0),
+      area_height(0), columns(1), rows(1), tile_width(1), tile_height(1), thumb_width(0), thumb_height(0),
+      cache_theme(-1), cache_width(0), cache_height(0)
+{
+}
+
+void SlideOverview::PadDeleter::operator()(WINDOW *pad) const
+{
+    delwin(pad);
+}
+
+void SlideOverview::set_resize_handler(std::function<void()> handler)
+{
+    resize_handler = std::move(handler);
+}
+
+void SlideOverview::compute_geometry(int screen_width, int screen_height)
+{
+    // Same area as the pane grid; its first and last rows hold the title and the key help
+    area_x = 2;
+    area_y = 2;
+    area_width = std::max(screen_width - 4, 10);
+    area_height = std::max(screen_height - 4, 6);
+    int grid_height = area_height - 2;
+
+    // Miniatures keep the proportions of the screen
+    columns = std::max(area_width / 24, 1);
+    tile_width = area_width / columns;
+    thumb_width = std::max(tile_width - 2, 1);
+    thumb_height = std::max(std::min(thumb_width * screen_height / std::max(screen_width, 1), grid_height - 2), 1);
+    tile_height = thumb_height + 2;
+    rows = std::max(grid_height / tile_height, 1);
+
+    if (thumb_width != cache_width || thumb_height != cache_height)
+    {
+        thumbnails.clear();
+        cache_width = thumb_width;
+        cache_height = thumb_height;
+    }
+}
+
+void SlideOverview::invalidate()
+{
+    thumbnails.clear();
+}
+
+void SlideOverview::relayout(int screen_width, int screen_height)
+{
+    compute_geometry(screen_width, screen_height);
+    scroll_to_selection();
+    draw();
+}
+
+int SlideOverview::show(EventLoop &loop, const SlideCollection &deck, int current_slide, int theme,
+                        int screen_width, int screen_height)
+{
+    slides = &deck;
+    selected = current_slide;
+    chosen = -1;
+    if (theme != cache_theme)
+    {
+        thumbnails.clear();
+        cache_theme = theme;
+    }
+    compute_geometry(screen_width, screen_height);
+    first_row = selected / columns;
+    scroll_to_selection();
+    draw();
+    refresh();
+
+    loop.run_modal([this, &loop]()
+                   { handle_input(loop); });
+    return chosen;
+}
+
+WINDOW *SlideOverview::thumbnail(int slide)
+{
+    auto found = thumbnails.find(slide);
+    if (found != thumbnails.end())
+        return found->second.get();
+
+    WINDOW *pad = newpad(thumb_height, thumb_width);
+    if (!pad)
+        return nullptr;
+    wbkgdset(pad, ' ' | COLOR_PAIR(0));
+    render_thumbnail(pad, slide);
+    thumbnails.emplace(slide, std::unique_ptr<WINDOW, PadDeleter>(pad));
+    return pad;
+}
+
+void SlideOverview::render_thumbnail(WINDOW *pad, int slide)
+{
+    // One row per element, in the element's colours; the title is centred
+    // and followed by the gap it has on the slide
+    werase(pad);
+    int row = 0;
+    for (const auto &element : slides->get_slide(slide))
+    {
+        if (row >= thumb_height)
+            break;
+        if (element.type == ElementType::SHELL_OUTPUT || element.type == ElementType::NOTE)
+            continue;
+
+        size_t start = element.content.find_first_not_of(' ');
+        if (start == std::string::npos)
+            continue;
+        std::string text = element.content.substr(start);
+
+        int column = element.x > 2 ? 1 : 0;
+        int attrs = COLOR_PAIR(element.color_pair);
+        if (element.type == ElementType::HEADER1)
+        {
+            column = std::max((thumb_width - (int)text.length()) / 2, 0);
+            attrs |= A_BOLD;
+        }
+        else if (element.is_bold)
+        {
+            attrs |= A_BOLD;
+        }
+
+        wattron(pad, attrs);
+        mvwaddnstr(pad, row, column, text.c_str(), thumb_width - column);
+        wattroff(pad, attrs);
+        row += element.type == ElementType::HEADER1 ? 2 : 1;
+    }
+}
+
+void SlideOverview::scroll_to_selection()
+{
+    int total_rows = (slides->get_slide_count() + columns - 1) / columns;
+    int row = selected / columns;
+    if (row < first_row)
+        first_row = row;
+    else if (row >= first_row + rows)
+        first_row = row - rows + 1;
+    first_row = std::max(std::min(first_row, total_rows - rows), 0);
+}
+
+void SlideOverview::draw()
+{
+    attron(COLOR_PAIR(0));
+    for (int i = 0; i < area_height; ++i)
+    {
+        mvhline(area_y + i, area_x, ' ', area_width);
+    }
+    attroff(COLOR_PAIR(0));
+
+    int count = slides->get_slide_count();
+    int per_page = columns * rows;
+    std::string title = "[ Overview: slide " + std::to_string(selected + 1) + " of " + std::to_string(count) +
+                        " | page " + std::to_string(first_row / rows + 1) + "/" +
+                        std::to_string((count + per_page - 1) / per_page) + " ]";
+    attron(COLOR_PAIR(1) | A_BOLD);
+    mvaddnstr(area_y, area_x, title.c_str(), area_width);
+    mvaddnstr(area_y + area_height - 1, area_x,
+              "[ ESC: Close | Arrows: Select | PgUp/PgDn: Page | ENTER: Go to slide ]", area_width);
+    attroff(COLOR_PAIR(1) | A_BOLD);
+
+    // Only the tiles on screen are looked up, and rendered if not cached yet
+    for (int row = 0; row < rows; ++row)
+    {
+        for (int column = 0; column < columns; ++column)
+        {
+            int slide = (first_row + row) * columns + column;
+            if (slide >= count)
+                return;
+            draw_tile(slide, area_y + 1 + row * tile_height, area_x + column * tile_width);
+        }
+    }
+}
+
+void SlideOverview::draw_tile(int slide, int y, int x)
+{
+    int attrs = slide == selected ? (COLOR_PAIR(4) | A_BOLD) : COLOR_PAIR(1);
+    attron(attrs);
+    mvhline(y, x, '-', tile_width);
+    mvhline(y + tile_height - 1, x, '-', tile_width);
+    mvvline(y + 1, x, '|', tile_height - 2);
+    mvvline(y + 1, x + tile_width - 1, '|', tile_height - 2);
+    std::string label = "[ " + std::to_string(slide + 1) + " ]";
+    mvaddnstr(y, x + 1, label.c_str(), tile_width - 2);
+    attroff(attrs);
+
+    WINDOW *pad = thumbnail(slide);
+    if (pad)
+        copywin(pad, stdscr, 0, 0, y + 1, x + 1, y + thumb_height, x + thumb_width, FALSE);
+}
+
+void SlideOverview::handle_input(EventLoop &loop)
+{
+    // A burst of keys (e.g. a held PgDn) is drawn once, at its end
+    int ch;
+    bool moved = false;
+    nodelay(stdscr, TRUE);
+    while (!loop.is_stopped() && (ch = InputRecorder::instance().read_key()) != ERR)
+    {
+        if (ch == KEY_RESIZE)
+        {
+            if (resize_handler)
+                resize_handler();
+            else
+                relayout(COLS, LINES);
+            refresh();
+        }
+        else if (!handle_key(ch))
+        {
+            loop.stop();
+        }
+        else
+        {
+            moved = true;
+        }
+    }
+    nodelay(stdscr, FALSE);
+
+    if (moved && !loop.is_stopped())
+    {
+        draw();
+        refresh();
+    }
+}
+
+bool SlideOverview::handle_key(int ch)
+{
+    int count = slides->get_slide_count();
+    int per_page = columns * rows;
+    switch (ch)
+    {
+    case 27: // ESC
+    case 'q':
+    case 'o':
+        return false;
+
+    case '\n':
+    case '\r':
+    case KEY_ENTER:
+        chosen = selected;
+        return false;
+
+    case KEY_LEFT:
+        selected--;
+        break;
+
+    case KEY_RIGHT:
+        selected++;
+        break;
+
+    case KEY_UP:
+        if (selected >= columns)
+            selected -= columns;
+        break;
+
+    case KEY_DOWN:
+        if (selected + columns < count)
+            selected += columns;
+        break;
+
+    case KEY_PPAGE:
+        // The page moves with the selection
+        selected -= per_page;
+        first_row -= rows;
+        break;
+
+    case KEY_NPAGE:
+        selected += per_page;
+        first_row += rows;
+        break;
+
+    case KEY_HOME:
+        selected = 0;
+        break;
+
+    case KEY_END:
+        selected = count - 1;
+        break;
+
+    default:
+        return true;
+    }
+
+    selected = std::max(std::min(selected, count - 1), 0);
+    scroll_to_selection();
+    return true;
+}
@@ -3,6 +3,12 @@
 #include "slide_renderer.hh"
 #include "ncurses_renderer.hh"
 #include "shell_popup.hh"
+#include "shell_pane_grid.hh"
+#include "slide_search_popup.hh"
+#include "phase_profiler.hh"
+#include "trace_recorder.hh"
+#include "input_recorder.hh"
+#include "slide_exporter.hh"
 #include <ncurses.h>
 #include <algorithm>
 #include <thread>
@@ -14,9 +20,55 @@
 #include <cstring>
 #include <locale.h>
 #include <sstream>
+#include <csignal>
+#include <unistd.h>
+
+namespace
+{
+    volatile sig_atomic_t latency_dump_requested = 0;
+
+    void request_latency_dump(int)
+    {
+        latency_dump_requested = 1;
+    }
+
+    // A follower is driven by the presenter; only keys about its own display work
+    bool is_follower_key(int ch)
+    {
+        switch (ch)
+        {
+        case 'q':
+        case 't':
+        case 'a':
+        case 'r':
+        case 'S':
+        case 'u':
+        case 'd':
+        case 'h':
+        case '?':
+        case KEY_RESIZE:
+            return true;
+        }
+        return false;
+    }
+
+    std::string slide_title(const std::vector<SlideElement> &elements)
+    {
+        for (const auto &element : elements)
+        {
+            if (element.type == ElementType::HEADER1 || element.type == ElementType::HEADER2 ||
+                element.type == ElementType::HEADER3)
+                return element.content;
+        }
+        return "(untitled)";
+    }
+}
 
 MarkdownSlideRenderer::MarkdownSlideRenderer()
-    : current_slide(0), show_timer(false), utf8_supported(false), current_theme(Theme::DARK)
+    : deck_loader(parser), current_slide(0), show_timer(false), utf8_supported(false), current_theme(static_cast<int>(Theme::DARK)),
+      use_animations(true), timer_fd(-1),
+      prefetched_for_slide(-1), prefetch_refused_shown(false), scrolled_pane(-1, -1), sent_slide(-1), show_stats_summary(false), show_stats_overlay(false),
+      pending_key(-1), key_received_us(0)
 {
 
     // Create ncurses renderer
@@ -55,6 +107,247 @@ MarkdownSlideRenderer::MarkdownSlideRenderer()
     }
 }
 
+void MarkdownSlideRenderer::set_stats_summary(bool enabled)
+{
+    show_stats_summary = enabled;
+}
+
+void MarkdownSlideRenderer::set_latency_json(const std::string &filename)
+{
+    latency_json_file = filename;
+    PhaseProfiler::instance().set_enabled(!filename.empty());
+
+    if (!filename.empty())
+    {
+        // No SA_RESTART: the signal has to interrupt the blocking wait
+        struct sigaction action = {};
+        action.sa_handler = request_latency_dump;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR1, &action, nullptr);
+    }
+}
+
+bool MarkdownSlideRenderer::load_themes(const std::string &filename, std::string &error)
+{
+    return renderer->load_themes(filename, error);
+}
+
+void MarkdownSlideRenderer::set_output_spill(bool enabled)
+{
+    job_options.spill_output = enabled;
+}
+
+void MarkdownSlideRenderer::set_use_pty(bool enabled)
+{
+    job_options.use_pty = enabled;
+    shell_session.set_use_pty(enabled);
+}
+
+void MarkdownSlideRenderer::set_shell_session(bool enabled)
+{
+    job_options.session = enabled ? &shell_session : nullptr;
+}
+
+bool MarkdownSlideRenderer::record_output(const std::string &filename, std::string &error)
+{
+    // Commands not run this time keep their earlier recordings
+    if (!command_recorder.load(filename, false, error))
+        return false;
+    recording_file = filename;
+    job_options.recorder = &command_recorder;
+    job_options.replay = false;
+    return true;
+}
+
+bool MarkdownSlideRenderer::replay_output(const std::string &filename, double speed, std::string &error)
+{
+    if (!command_recorder.load(filename, true, error))
+        return false;
+    job_options.recorder = &command_recorder;
+    job_options.replay = true;
+    job_options.replay_speed = speed;
+    return true;
+}
+
+bool MarkdownSlideRenderer::record_input(const std::string &filename, std::string &error)
+{
+    return InputRecorder::instance().record(filename, error);
+}
+
+bool MarkdownSlideRenderer::replay_input(const std::string &filename, double speed, std::string &error)
+{
+    return InputRecorder::instance().replay(filename, speed, error);
+}
+
+bool MarkdownSlideRenderer::start_presenter_view(const std::string &socket_path, std::string &error)
+{
+    if (!presenter_link.listen(socket_path, event_loop, [this](std::vector<PresenterLink::Message> &state)
+                               { presenter_state(state); },
+                               error))
+        return false;
+    // The presenter always sees the clock
+    show_timer = true;
+    return true;
+}
+
+void MarkdownSlideRenderer::follow_presenter(const std::string &socket_path)
+{
+    // Connected once the screen is set up, in run()
+    follow_socket = socket_path;
+}
+
+bool MarkdownSlideRenderer::set_trace_file(const std::string &filename)
+{
+    return TraceRecorder::instance().open(filename);
+}
+
+void MarkdownSlideRenderer::write_latency_json()
+{
+    latency_dump_requested = 0;
+    if (!latency_json_file.empty())
+    {
+        PhaseProfiler::instance().write_json(latency_json_file);
+    }
+}
+
+void MarkdownSlideRenderer::begin_key(int ch)
+{
+    output_stats.begin_action();
+
+    TraceRecorder &tracer = TraceRecorder::instance();
+    if (tracer.is_enabled())
+    {
+        key_received_us = tracer.now_us();
+        pending_key = ch;
+        tracer.instant("get_input", "input", ch);
+    }
+}
+
+void MarkdownSlideRenderer::end_key()
+{
+    // Everything drawn since the key arrived belongs to that key's action
+    output_stats.end_action();
+    if (show_stats_overlay)
+    {
+        renderer->draw_stats_overlay(output_stats.format_overlay());
+        renderer->refresh_display();
+    }
+
+    TraceRecorder &tracer = TraceRecorder::instance();
+    if (tracer.is_enabled() && pending_key >= 0)
+    {
+        tracer.complete("key_to_screen", "input", key_received_us, tracer.now_us(), pending_key);
+        pending_key = -1;
+    }
+}
+
+void MarkdownSlideRenderer::process_pending_input()
+{
+    if (latency_dump_requested)
+        write_latency_json();
+
+    // Drain everything that is buffered; the loop sleeps again afterwards
+    int ch = renderer->poll_input();
+    while (!event_loop.is_stopped() && ch != ERR)
+    {
+        if (presenter_link.is_follower() && !is_follower_key(ch))
+        {
+            ch = renderer->poll_input();
+            continue;
+        }
+
+        // Fold a run of navigation keys (e.g. auto-repeat) into one target slide
+        // and draw only that slide instead of every slide in between
+        int target = current_slide;
+        int moves = 0;
+        bool jumped = false;
+        begin_key(ch);
+        while (ch != ERR && apply_navigation_key(ch, target, jumped))
+        {
+            moves++;
+            ch = renderer->poll_input();
+        }
+
+        if (moves > 0)
+        {
+            shell_selector.exit_selection_mode();
+            renderer->clear_message_area();
+            // Home/End always redraw; relative moves only when they changed the slide
+            if (target != current_slide || jumped)
+            {
+                current_slide = target;
+                render_current_slide(use_animations && moves == 1 && !jumped);
+            }
+            check_for_shell_commands();
+            end_key();
+            continue; // ch already holds the next unhandled key
+        }
+
+        if (!handle_key(ch))
+            event_loop.stop();
+        end_key();
+        ch = renderer->poll_input();
+    }
+
+    if (!event_loop.is_stopped() && !presenter_link.is_follower())
+        prefetch_upcoming_commands();
+}
+
+bool MarkdownSlideRenderer::apply_navigation_key(int ch, int &target, bool &jumped) const
+{
+    switch (ch)
+    {
+    case KEY_RIGHT:
+    case ' ':
+    case 'l':
+        target = std::min(target + 1, slides.get_slide_count() - 1);
+        return true;
+
+    case KEY_LEFT:
+    case KEY_BACKSPACE:
+        target = std::max(target - 1, 0);
+        return true;
+
+    case KEY_HOME:
+    case '0':
+        target = 0;
+        jumped = true;
+        return true;
+
+    case KEY_END:
+    case '$':
+        target = slides.get_slide_count() - 1;
+        jumped = true;
+        return true;
+    }
+    return false;
+}
+
+void MarkdownSlideRenderer::update_timer_tick()
+{
+    if (show_timer && timer_fd < 0)
+    {
+        // First tick on the next whole second of the presentation clock
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - start_time)
+                           .count();
+        timer_fd = event_loop.add_timer(1000 - (int)(elapsed % 1000), 1000, [this]()
+                                        {
+                                            // Under a popup the clock catches up when it closes
+                                            if (event_loop.in_modal())
+                                                return;
+                                            // Retained chrome repaints only the timer cells
+                                            draw_chrome();
+                                            renderer->refresh_display();
+                                        });
+    }
+    else if (!show_timer && timer_fd >= 0)
+    {
+        event_loop.remove_timer(timer_fd);
+        timer_fd = -1;
+    }
+}
+
 void MarkdownSlideRenderer::goto_slide()
 {
     renderer->clear_screen();
@@ -76,6 +369,53 @@ void MarkdownSlideRenderer::goto_slide()
     render_current_slide(false);
 }
 
+void MarkdownSlideRenderer::search_slides()
+{
+    shell_selector.exit_selection_mode();
+    renderer->clear_message_area();
+
+    SlideSearchPopup popup(renderer->get_screen_width(), renderer->get_screen_height());
+    popup.set_resize_handler([this, &popup]()
+                             {
+                                 renderer->begin_frame();
+                                 renderer->clear_screen();
+                                 render_current_slide(false);
+                                 popup.relayout(renderer->get_screen_width(), renderer->get_screen_height());
+                                 renderer->end_frame();
+                             });
+    int slide = popup.show(event_loop, deck_index, slides);
+    if (slide >= 0)
+        current_slide = slide;
+
+    renderer->invalidate_chrome();
+    render_current_slide(false);
+    check_for_shell_commands();
+}
+
+void MarkdownSlideRenderer::show_overview()
+{
+    shell_selector.exit_selection_mode();
+    renderer->clear_message_area();
+
+    overview.set_resize_handler([this]()
+                                {
+                                    renderer->begin_frame();
+                                    renderer->clear_screen();
+                                    render_current_slide(false);
+                                    overview.relayout(renderer->get_screen_width(), renderer->get_screen_height());
+                                    renderer->end_frame();
+                                });
+    int slide = overview.show(event_loop, slides, current_slide, current_theme, renderer->get_screen_width(),
+                              renderer->get_screen_height());
+    if (slide >= 0)
+        current_slide = slide;
+
+    // The overview covered the chrome as well as the slide
+    renderer->invalidate_chrome();
+    render_current_slide(false);
+    check_for_shell_commands();
+}
+
 void MarkdownSlideRenderer::get_timer_values(int &minutes, int &seconds)
 {
     if (show_timer)
@@ -93,28 +433,122 @@ void MarkdownSlideRenderer::get_timer_values(int &minutes, int &seconds)
 
 std::string MarkdownSlideRenderer::get_current_theme_name()
 {
-    const char *theme_names[] = {"Dark", "Light", "Matrix", "Retro"};
-    return theme_names[static_cast<int>(current_theme)];
+    return renderer->get_theme_name(current_theme);
 }
 
-void MarkdownSlideRenderer::render_current_slide(bool animated)
+void MarkdownSlideRenderer::draw_chrome()
 {
     int minutes, seconds;
     get_timer_values(minutes, seconds);
 
-    renderer->draw_header(current_slide, slides.get_slide_count(), get_current_theme_name(),
-                          show_timer, minutes, seconds, utf8_supported);
-    renderer->draw_footer();
-    renderer->draw_progress_bar(current_slide, slides.get_slide_count());
-    renderer->refresh_display();
+    {
+        ScopedPhase timing(Phase::DRAW_HEADER);
+        renderer->draw_header(current_slide, slides.get_slide_count(), get_current_theme_name(),
+                              show_timer, minutes, seconds, utf8_supported);
+    }
+    {
+        ScopedPhase timing(Phase::DRAW_FOOTER);
+        renderer->draw_footer();
+    }
+    {
+        ScopedPhase timing(Phase::DRAW_PROGRESS);
+        renderer->draw_progress_bar(current_slide, slides.get_slide_count());
+    }
+}
 
-    renderer->render_slide(slides.get_slide(current_slide), animated);
-    renderer->refresh_display();
+void MarkdownSlideRenderer::render_current_slide(bool animated)
+{
+    // The follower hears of a new slide before this one starts drawing it
+    if (presenter_link.is_presenter() && current_slide != sent_slide)
+    {
+        presenter_link.send({PresenterLink::Kind::SLIDE, current_slide});
+        sent_slide = current_slide;
+    }
+
+    // Without animation the whole slide reaches the terminal in one flush
+    if (!animated)
+        renderer->begin_frame();
+
+    slides.ensure_layout(current_slide, renderer->get_screen_width());
+    output_stats.begin_frame();
+    draw_chrome();
+    // An animation starts with the chrome already on screen
+    if (animated)
+    {
+        ScopedPhase timing(Phase::REFRESH);
+        renderer->refresh_display();
+    }
+    {
+        ScopedPhase timing(Phase::RENDER_SLIDE);
+        renderer->render_slide(slides.get_slide(current_slide), animated);
+        draw_inline_panes();
+        if (presenter_link.is_presenter())
+            draw_presenter_notes();
+        if (mirrored_popup)
+            mirrored_popup->relayout(renderer->get_screen_width(), renderer->get_screen_height());
+    }
+    {
+        // Within a frame the flush happens at end_frame(), so that is what is timed
+        ScopedPhase timing(Phase::REFRESH);
+        if (animated)
+            renderer->refresh_display();
+        else
+            renderer->end_frame();
+    }
+    output_stats.end_frame(current_slide);
+}
+
+bool MarkdownSlideRenderer::load_slides(const std::vector<std::string> &paths, std::string &error)
+{
+    if (!deck_loader.load(paths, slides, error))
+        return false;
+    deck_paths = paths;
+    deck_index.build(slides);
+    return true;
+}
+
+bool MarkdownSlideRenderer::reload_deck(std::string &error)
+{
+    // Only files changed on disk are parsed again
+    SlideCollection reloaded;
+    if (!deck_loader.load(deck_paths, reloaded, error) || reloaded.is_empty())
+    {
+        if (error.empty())
+            error = "no slides";
+        return false;
+    }
+
+    // Slide numbers may have moved, so state kept by slide number goes
+    stop_inline_jobs();
+    stop_prefetch_jobs();
+    prefetched_for_slide = -1;
+    slides = std::move(reloaded);
+    current_slide = std::min(current_slide, slides.get_slide_count() - 1);
+    deck_index.build(slides);
+    overview.invalidate();
+    presenter_link.send({PresenterLink::Kind::DECK, 0, 0, slides.get_slide_count()});
+    return true;
 }
 
-void MarkdownSlideRenderer::load_slides(const std::string &filename)
+void MarkdownSlideRenderer::reload_slides()
 {
-    parser.load_slides(filename, slides);
+    shell_selector.exit_selection_mode();
+    renderer->clear_message_area();
+    std::string error;
+    if (!reload_deck(error))
+    {
+        renderer->show_message("Reload failed: " + error, renderer->get_screen_height() - 5);
+        renderer->refresh_display();
+        return;
+    }
+
+    renderer->invalidate_chrome();
+    render_current_slide(false);
+    renderer->show_message("Reloaded " + std::to_string(slides.get_slide_count()) + " slides; parsed " +
+                               std::to_string(deck_loader.get_parsed_count()) + " of " +
+                               std::to_string(deck_loader.get_file_count()) + " files",
+                           renderer->get_screen_height() - 5);
+    renderer->refresh_display();
 }
 
 void MarkdownSlideRenderer::run()
@@ -127,144 +561,227 @@ void MarkdownSlideRenderer::run()
 
     renderer->initialize();
     renderer->apply_theme(current_theme);
+    // A replay restores the recorded screen size before anything is laid out
+    InputRecorder::instance().start();
     start_time = std::chrono::steady_clock::now();
 
-    bool use_animations = true;
-
     // Initial render
     render_current_slide(use_animations);
     check_for_shell_commands();
+    if (follow_socket.empty())
+        prefetch_upcoming_commands();
 
-    int ch;
-    while ((ch = renderer->get_input()) != 'q')
+    event_loop.add_fd(STDIN_FILENO, [this](uint32_t)
+                      { process_pending_input(); });
+    // SIGWINCH and SIGUSR1 interrupt the wait; ncurses reports the resize as a key
+    event_loop.set_interrupt_handler([this]()
+                                     { process_pending_input(); });
+    update_timer_tick();
+    if (!follow_socket.empty())
     {
-        // Handle shell command selection first
-        if (shell_selector.is_active())
+        auto show_connection = [this](bool connected)
         {
-            if (handle_shell_selection_input(ch))
-            {
-                continue; // Input was handled by selection system
-            }
+            renderer->clear_message_area();
+            if (!connected)
+                renderer->show_message("Waiting for the presenter at " + follow_socket,
+                                       renderer->get_screen_height() - 5);
+            renderer->refresh_display();
+        };
+        presenter_link.follow(follow_socket, event_loop,
+                              [this](const PresenterLink::Message &message)
+                              { handle_presenter_message(message); },
+                              show_connection);
+        if (!presenter_link.is_connected())
+            show_connection(false);
+    }
+    event_loop.run();
+
+    if (timer_fd >= 0)
+    {
+        event_loop.remove_timer(timer_fd);
+        timer_fd = -1;
+    }
+    stop_prefetch_jobs();
+    stop_inline_jobs();
+    mirrored_popup.reset();
+    presenter_link.close();
+    event_loop.remove_fd(STDIN_FILENO);
+
+    renderer->cleanup();
+    write_latency_json();
+    if (!recording_file.empty() && command_recorder.has_changes() && !command_recorder.save(recording_file))
+    {
+        fprintf(stderr, "Cannot write recorded output: %s\n", recording_file.c_str());
+    }
+    TraceRecorder::instance().close();
+    if (!InputRecorder::instance().close())
+    {
+        fprintf(stderr, "Cannot write input recording\n");
+    }
+
+    if (show_stats_summary)
+    {
+        fprintf(stderr, "%s", output_stats.format_summary().c_str());
+    }
+}
+
+bool MarkdownSlideRenderer::export_slides(const std::string &format_name, int width, std::string &error)
+{
+    ExportFormat format;
+    if (!SlideExporter::parse_format(format_name, format))
+    {
+        error = "Unknown export format: " + format_name + " (ansi, txt or html)";
+        return false;
+    }
+
+    SlideExporter exporter(format, width, renderer->get_theme_config(current_theme));
+    bool written = exporter.write(slides, stdout, error);
+    write_latency_json();
+    TraceRecorder::instance().close();
+    return written;
+}
+
+// Everything except slide navigation, which process_pending_input() coalesces
+bool MarkdownSlideRenderer::handle_key(int ch)
+{
+    if (ch == 'q')
+        return false;
+
+    // Handle shell command selection first
+    if (shell_selector.is_active())
+    {
+        if (handle_shell_selection_input(ch))
+        {
+            return true; // Input was handled by selection system
         }
+    }
 
-        switch (ch)
+    switch (ch)
+    {
+    case '\n':
+    case '\r':
+    case KEY_ENTER:
+        if (shell_selector.is_active())
         {
-        case KEY_RIGHT:
-        case ' ':
-        case 'l':
-            shell_selector.exit_selection_mode();
-            renderer->clear_message_area();
-            if (current_slide < slides.get_slide_count() - 1)
-            {
-                current_slide++;
-                render_current_slide(use_animations);
-                check_for_shell_commands();
-            }
-            break;
+            execute_selected_shell_command();
+        }
+        else
+        {
+            start_shell_command_selection();
+        }
+        break;
 
-        case KEY_LEFT:
-        case KEY_BACKSPACE:
-            shell_selector.exit_selection_mode();
-            renderer->clear_message_area();
-            if (current_slide > 0)
-            {
-                current_slide--;
-                render_current_slide(use_animations);
-                check_for_shell_commands();
-            }
-            break;
+    case 'g':
+        shell_selector.exit_selection_mode();
+        renderer->clear_message_area();
+        goto_slide();
+        check_for_shell_commands();
+        break;
 
-        case '\n':
-        case '\r':
-        case KEY_ENTER:
-            if (shell_selector.is_active())
-            {
-                execute_selected_shell_command();
-            }
-            else
-            {
-                start_shell_command_selection();
-            }
-            break;
+    case '/':
+        search_slides();
+        break;
 
-        case KEY_HOME:
-        case '0':
-            shell_selector.exit_selection_mode();
-            renderer->clear_message_area();
-            current_slide = 0;
-            render_current_slide(false);
-            check_for_shell_commands();
-            break;
+    case 'o':
+        show_overview();
+        break;
 
-        case KEY_END:
-        case '$':
-            shell_selector.exit_selection_mode();
-            renderer->clear_message_area();
-            current_slide = slides.get_slide_count() - 1;
-            render_current_slide(false);
-            check_for_shell_commands();
-            break;
+    case 'R':
+        reload_slides();
+        break;
 
-        case 'g':
-            shell_selector.exit_selection_mode();
-            renderer->clear_message_area();
-            goto_slide();
-            check_for_shell_commands();
-            break;
+    case 't':
+        // Recolour the frame in place; only the theme name in the header is
+        // redrawn, and command output, whose colours are mixed with the theme's
+        current_theme = (current_theme + 1) % renderer->get_theme_count();
+        renderer->begin_frame();
+        renderer->apply_theme(current_theme);
+        OutputView::reset_colors();
+        draw_chrome();
+        draw_inline_panes();
+        if (mirrored_popup)
+            mirrored_popup->relayout(renderer->get_screen_width(), renderer->get_screen_height());
+        renderer->end_frame();
+        break;
 
-        case 't':
-            current_theme = static_cast<Theme>((static_cast<int>(current_theme) + 1) % 4);
-            renderer->apply_theme(current_theme);
-            render_current_slide(false);
-            if (!shell_selector.is_active())
-            {
-                check_for_shell_commands();
-            }
-            break;
+    case 'A':
+        run_all_shell_commands();
+        break;
 
-        case 'a':
-            use_animations = !use_animations;
-            render_current_slide(false);
-            if (!shell_selector.is_active())
-            {
-                check_for_shell_commands();
-            }
-            break;
+    case 'u':
+    case 'd':
+        scroll_inline_pane(ch == 'u');
+        break;
 
-        case 'T':
-            show_timer = !show_timer;
-            render_current_slide(false);
-            if (!shell_selector.is_active())
-            {
-                check_for_shell_commands();
-            }
-            break;
+    case 'a':
+        use_animations = !use_animations;
+        render_current_slide(false);
+        if (!shell_selector.is_active())
+        {
+            check_for_shell_commands();
+        }
+        break;
 
-        case 'r':
-            render_current_slide(false);
-            if (!shell_selector.is_active())
-            {
-                check_for_shell_commands();
-            }
-            break;
+    case 'T':
+        show_timer = !show_timer;
+        update_timer_tick();
+        presenter_link.send(timer_message());
+        draw_chrome();
+        renderer->refresh_display();
+        break;
 
-        case 'h':
-        case '?':
-            shell_selector.exit_selection_mode();
-            renderer->clear_message_area();
-            renderer->show_help(utf8_supported);
-            renderer->get_input(); // Wait for key press
-            render_current_slide(false);
+    case 'S':
+        show_stats_overlay = !show_stats_overlay;
+        if (!show_stats_overlay)
+        {
+            renderer->draw_stats_overlay("");
+            renderer->refresh_display();
+        }
+        break;
+
+    case 'r':
+        render_current_slide(false);
+        if (!shell_selector.is_active())
+        {
             check_for_shell_commands();
-            break;
         }
+        break;
+
+    case KEY_RESIZE:
+        handle_resize();
+        break;
+
+    case 'h':
+    case '?':
+        shell_selector.exit_selection_mode();
+        renderer->clear_message_area();
+        renderer->show_help(utf8_supported);
+        renderer->get_input(); // Wait for key press
+        render_current_slide(false);
+        check_for_shell_commands();
+        break;
     }
+    return true;
+}
 
-    renderer->cleanup();
+void MarkdownSlideRenderer::handle_resize()
+{
+    // ncurses has already resized stdscr; redraw the visible slide and the
+    // chrome for the new size in a single flush
+    shell_selector.exit_selection_mode();
+    renderer->begin_frame();
+    renderer->clear_screen();
+    render_current_slide(false);
+    check_for_shell_commands();
+    renderer->end_frame();
 }
 
 void MarkdownSlideRenderer::check_for_shell_commands()
 {
+    // A follower's commands are run by the presenter
+    if (!follow_socket.empty())
+        return;
+
     // Check if current slide has shell commands
     for (const auto &element : slides.get_slide(current_slide))
     {
@@ -278,7 +795,8 @@ void MarkdownSlideRenderer::check_for_shell_commands()
 
 void MarkdownSlideRenderer::show_shell_command_hint()
 {
-    renderer->show_message("Shell commands detected! Press ENTER to select command", LINES - 5);
+    renderer->show_message("Shell commands detected! Press ENTER to select command",
+                           renderer->get_screen_height() - 5);
 }
 
 void MarkdownSlideRenderer::start_shell_command_selection()
@@ -291,11 +809,11 @@ void MarkdownSlideRenderer::start_shell_command_selection()
         std::string msg = "Use ↑↓ to select command (" +
                           std::to_string(shell_selector.get_command_count()) +
                           " available), ENTER to execute, ESC to cancel";
-        renderer->show_message(msg, LINES - 5);
+        renderer->show_message(msg, renderer->get_screen_height() - 5);
     }
     else
     {
-        renderer->show_message("No shell commands found on this slide", LINES - 5);
+        renderer->show_message("No shell commands found on this slide", renderer->get_screen_height() - 5);
     }
 }
 
@@ -310,7 +828,7 @@ bool MarkdownSlideRenderer::handle_shell_selection_input(int ch)
             std::string msg = "Command " + std::to_string(shell_selector.get_selected_index() + 1) +
                               " of " + std::to_string(shell_selector.get_command_count()) +
                               " selected. ENTER to execute, ESC to cancel";
-            renderer->show_message(msg, LINES - 5);
+            renderer->show_message(msg, renderer->get_screen_height() - 5);
         }
         return true;
 
@@ -321,7 +839,7 @@ bool MarkdownSlideRenderer::handle_shell_selection_input(int ch)
             std::string msg = "Command " + std::to_string(shell_selector.get_selected_index() + 1) +
                               " of " + std::to_string(shell_selector.get_command_count()) +
                               " selected. ENTER to execute, ESC to cancel";
-            renderer->show_message(msg, LINES - 5);
+            renderer->show_message(msg, renderer->get_screen_height() - 5);
         }
         return true;
 
@@ -350,12 +868,445 @@ void MarkdownSlideRenderer::execute_selected_shell_command()
         shell_selector.exit_selection_mode();
         renderer->clear_message_area();
 
+        // !inline commands run in the pane under their fence
+        auto &elements = slides.get_slide(current_slide);
+        int index = (int)(selected - elements.data());
+        if (selected->inline_output && index + 1 < (int)elements.size() &&
+            elements[index + 1].type == ElementType::SHELL_OUTPUT)
+        {
+            run_inline_command(index + 1);
+            check_for_shell_commands();
+            return;
+        }
+
         // Create and show popup
         ShellPopup popup(renderer->get_screen_width(), renderer->get_screen_height());
-        popup.show(selected->shell_command);
+        popup.set_job_options(job_options);
+        if (presenter_link.is_presenter())
+            popup.set_job_handler([this](ShellJob &job)
+                                  { mirror_job(job, current_slide, -1); });
+        popup.set_resize_handler([this, &popup]()
+                                 {
+                                     renderer->begin_frame();
+                                     renderer->clear_screen();
+                                     render_current_slide(false);
+                                     popup.relayout(renderer->get_screen_width(), renderer->get_screen_height());
+                                     renderer->end_frame();
+                                 });
+        popup.show(event_loop, selected->shell_command, take_prefetched_job(selected->shell_command));
+        presenter_link.send({PresenterLink::Kind::POPUP_CLOSE});
 
-        // Refresh slide after popup closes
+        // Refresh slide after popup closes; the popup may have covered the chrome
+        renderer->invalidate_chrome();
         render_current_slide(false);
         check_for_shell_commands();
     }
-}
\ No newline at end of file
+}
+
+void MarkdownSlideRenderer::run_all_shell_commands()
+{
+    std::vector<std::string> commands;
+    std::vector<std::unique_ptr<ShellJob>> prefetched;
+    for (const auto &element : slides.get_slide(current_slide))
+    {
+        if (element.type == ElementType::SHELL_COMMAND)
+        {
+            commands.push_back(element.shell_command);
+            prefetched.push_back(take_prefetched_job(element.shell_command));
+        }
+    }
+
+    if (commands.empty())
+    {
+        renderer->show_message("No shell commands found on this slide", renderer->get_screen_height() - 5);
+        return;
+    }
+
+    shell_selector.exit_selection_mode();
+    renderer->clear_message_area();
+
+    ShellPaneGrid grid(renderer->get_screen_width(), renderer->get_screen_height());
+    grid.set_job_options(job_options);
+    grid.set_resize_handler([this, &grid]()
+                            {
+                                renderer->begin_frame();
+                                renderer->clear_screen();
+                                render_current_slide(false);
+                                grid.relayout(renderer->get_screen_width(), renderer->get_screen_height());
+                                renderer->end_frame();
+                            });
+    grid.show(event_loop, commands, std::move(prefetched));
+
+    // The grid covered the chrome as well as the slide
+    renderer->invalidate_chrome();
+    render_current_slide(false);
+    check_for_shell_commands();
+}
+
+std::unique_ptr<ShellJob> MarkdownSlideRenderer::take_prefetched_job(const std::string &command)
+{
+    // Hand over a prefetched run of this command, finished or not
+    auto found = prefetch_jobs.find(command);
+    if (found == prefetch_jobs.end())
+        return nullptr;
+
+    std::unique_ptr<ShellJob> job = std::move(found->second);
+    prefetch_jobs.erase(found);
+    if (job->is_running())
+        event_loop.remove_fd(job->output_fd());
+    return job;
+}
+
+void MarkdownSlideRenderer::prefetch_upcoming_commands()
+{
+    // Start once per arrival on a slide, for the !prefetch commands of the next one
+    if (current_slide == prefetched_for_slide)
+        return;
+    prefetched_for_slide = current_slide;
+    if (current_slide + 1 >= slides.get_slide_count())
+        return;
+
+    for (const auto &element : slides.get_slide(current_slide + 1))
+    {
+        if (element.type != ElementType::SHELL_COMMAND || !element.prefetch)
+            continue;
+
+        // A prefetch in the session would run ahead of the commands before
+        // it, and outside of it the session's state would be missing
+        if (job_options.session)
+        {
+            if (!prefetch_refused_shown)
+                renderer->show_message("!prefetch is ignored with --shell-session", renderer->get_screen_height() - 4);
+            prefetch_refused_shown = true;
+            return;
+        }
+
+        // A run still in progress is kept; an older result is refreshed
+        auto &job = prefetch_jobs[element.shell_command];
+        if (job && job->is_running())
+            continue;
+
+        // Sized for the popup it will most likely be shown in
+        ShellJobOptions options = job_options;
+        ShellPopup::output_size(renderer->get_screen_width(), renderer->get_screen_height(), options.rows,
+                                options.columns);
+        job = std::make_unique<ShellJob>(element.shell_command);
+        job->start(options);
+        if (job->is_running())
+        {
+            ShellJob *running = job.get();
+            int fd = running->output_fd();
+            event_loop.add_fd(fd, [this, running, fd](uint32_t)
+                              {
+                                  if (!running->read_available())
+                                      event_loop.remove_fd(fd);
+                              });
+        }
+    }
+}
+
+void MarkdownSlideRenderer::stop_prefetch_jobs()
+{
+    for (auto &entry : prefetch_jobs)
+    {
+        if (entry.second->is_running())
+        {
+            event_loop.remove_fd(entry.second->output_fd());
+            entry.second->stop();
+        }
+    }
+    prefetch_jobs.clear();
+}
+
+void MarkdownSlideRenderer::run_inline_command(int output_index)
+{
+    SlideElement &output = slides.get_slide(current_slide)[output_index];
+    InlinePane &pane = inline_panes[{current_slide, output_index}];
+
+    // ENTER on a command that is still running starts it again; stop()
+    // tells the listener the old run ended
+    if (pane.job && pane.job->is_running())
+    {
+        event_loop.remove_fd(pane.job->output_fd());
+        pane.job->stop();
+    }
+
+    output.executed = true;
+    scrolled_pane = {current_slide, output_index};
+    pane.job = take_prefetched_job(output.shell_command);
+    if (!pane.job)
+    {
+        ShellJobOptions options = job_options;
+        options.rows = output.max_output_lines;
+        options.columns = std::max(renderer->get_screen_width() - output.x - 2, 1);
+        pane.job = std::make_unique<ShellJob>(output.shell_command);
+        pane.job->start(options);
+    }
+    pane.view.set_buffer(&pane.job->get_output());
+    if (presenter_link.is_presenter())
+        mirror_job(*pane.job, current_slide, output_index);
+
+    if (pane.job->is_running())
+    {
+        int slide = current_slide;
+        event_loop.add_fd(pane.job->output_fd(), [this, slide, output_index](uint32_t)
+                          { read_inline_output(slide, output_index); });
+    }
+
+    // Replaces the placeholder; a prefetched job is resized to the pane here
+    draw_inline_pane(current_slide, output_index);
+    renderer->refresh_display();
+}
+
+void MarkdownSlideRenderer::read_inline_output(int slide, int output_index)
+{
+    InlinePane &pane = inline_panes.at({slide, output_index});
+    int fd = pane.job->output_fd();
+    if (!pane.job->read_available())
+        event_loop.remove_fd(fd);
+    pane.view.update();
+
+    // Panes of other slides, or under a popup, only collect output until
+    // they are shown again; a visible one redraws just its own cells
+    if (slide == current_slide && !event_loop.in_modal())
+    {
+        draw_inline_pane(slide, output_index);
+        renderer->refresh_display();
+    }
+}
+
+void MarkdownSlideRenderer::draw_inline_pane(int slide, int output_index)
+{
+    InlinePane &pane = inline_panes.at({slide, output_index});
+    const SlideElement &output = slides.get_slide(slide)[output_index];
+
+    // Clipped above the message row, like the rest of the slide content
+    int height = std::min(output.max_output_lines, renderer->get_screen_height() - 5 - output.y);
+    int width = renderer->get_screen_width() - output.x - 2;
+    if (height < 1 || width < 1)
+        return;
+
+    bool resized = height != pane.view.get_height() || width != pane.view.get_width();
+    pane.view.set_area(output.y, output.x, height, width);
+    if (resized && pane.job->is_running())
+        pane.job->resize(height, width);
+    pane.view.draw(6);
+}
+
+void MarkdownSlideRenderer::draw_inline_panes()
+{
+    for (auto it = inline_panes.lower_bound({current_slide, 0});
+         it != inline_panes.end() && it->first.first == current_slide; ++it)
+    {
+        draw_inline_pane(it->first.first, it->first.second);
+    }
+}
+
+void MarkdownSlideRenderer::scroll_inline_pane(bool up)
+{
+    // The pane run last on this slide, else its first one
+    auto found = inline_panes.find(scrolled_pane);
+    if (found == inline_panes.end() || scrolled_pane.first != current_slide)
+        found = inline_panes.lower_bound({current_slide, 0});
+    if (found == inline_panes.end() || found->first.first != current_slide)
+        return;
+
+    // Half a pane at a time, as with less's u/d
+    OutputView &view = found->second.view;
+    int rows = std::max(view.get_height() / 2, 1);
+    if (up)
+        view.scroll_up(rows);
+    else
+        view.scroll_down(rows);
+    draw_inline_pane(found->first.first, found->first.second);
+    renderer->refresh_display();
+}
+
+void MarkdownSlideRenderer::stop_inline_jobs()
+{
+    for (auto &entry : inline_panes)
+    {
+        if (entry.second.job->is_running())
+        {
+            event_loop.remove_fd(entry.second.job->output_fd());
+            entry.second.job->stop();
+        }
+    }
+    inline_panes.clear();
+}
+
+void MarkdownSlideRenderer::mirror_job(ShellJob &job, int slide, int element)
+{
+    // The follower shows the run as it happens, from the same bytes
+    presenter_link.send({PresenterLink::Kind::JOB_START, slide, element, 0, job.get_command()});
+    job.set_listener(
+        [this, slide, element](const std::string &chunk)
+        { presenter_link.send({PresenterLink::Kind::JOB_OUTPUT, slide, element, 0, chunk}); },
+        [this, slide, element](const std::string &status)
+        { presenter_link.send({PresenterLink::Kind::JOB_END, slide, element, 0, status}); });
+}
+
+PresenterLink::Message MarkdownSlideRenderer::timer_message() const
+{
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+    return {PresenterLink::Kind::TIMER, 0, 0, show_timer ? (int64_t)elapsed.count() : -1};
+}
+
+void MarkdownSlideRenderer::presenter_state(std::vector<PresenterLink::Message> &state)
+{
+    // What a follower that just connected needs; later only changes are sent
+    state.push_back({PresenterLink::Kind::DECK, 0, 0, slides.get_slide_count()});
+    state.push_back({PresenterLink::Kind::SLIDE, current_slide});
+    state.push_back(timer_message());
+    for (auto &entry : inline_panes)
+    {
+        int slide = entry.first.first;
+        int element = entry.first.second;
+        ShellJob &job = *entry.second.job;
+        state.push_back({PresenterLink::Kind::JOB_START, slide, element, 0, job.get_command()});
+        state.push_back({PresenterLink::Kind::JOB_OUTPUT, slide, element, 0, job.get_output_text()});
+        if (!job.is_running())
+            state.push_back({PresenterLink::Kind::JOB_END, slide, element, 0, job.get_status()});
+    }
+    sent_slide = current_slide;
+}
+
+void MarkdownSlideRenderer::handle_presenter_message(const PresenterLink::Message &message)
+{
+    switch (message.kind)
+    {
+    case PresenterLink::Kind::DECK:
+    {
+        // Both read the same files; whatever the presenter reloaded is reloaded here
+        std::string error;
+        if (!reload_deck(error))
+            error = "Reload failed: " + error;
+        else if (slides.get_slide_count() != message.value)
+            error = "The presenter's deck has " + std::to_string(message.value) + " slides, this one " +
+                    std::to_string(slides.get_slide_count());
+        renderer->invalidate_chrome();
+        render_current_slide(false);
+        if (!error.empty())
+            renderer->show_message(error, renderer->get_screen_height() - 5);
+        renderer->refresh_display();
+        break;
+    }
+
+    case PresenterLink::Kind::SLIDE:
+        if (message.slide < 0 || message.slide >= slides.get_slide_count() || message.slide == current_slide)
+            break;
+        current_slide = message.slide;
+        render_current_slide(use_animations);
+        break;
+
+    case PresenterLink::Kind::TIMER:
+        show_timer = message.value >= 0;
+        if (show_timer)
+            start_time = std::chrono::steady_clock::now() - std::chrono::milliseconds(message.value);
+        update_timer_tick();
+        draw_chrome();
+        renderer->refresh_display();
+        break;
+
+    case PresenterLink::Kind::JOB_START:
+        start_mirrored_job(message.slide, message.element, message.text);
+        draw_mirrored_job(message.slide, message.element);
+        break;
+
+    case PresenterLink::Kind::JOB_OUTPUT:
+    case PresenterLink::Kind::JOB_END:
+        if (ShellJob *job = find_mirrored_job(message.slide, message.element))
+        {
+            if (message.kind == PresenterLink::Kind::JOB_OUTPUT)
+                job->mirror_output(message.text);
+            else
+                job->mirror_end(message.text);
+            draw_mirrored_job(message.slide, message.element);
+        }
+        break;
+
+    case PresenterLink::Kind::POPUP_CLOSE:
+        if (mirrored_popup)
+        {
+            mirrored_popup.reset();
+            renderer->invalidate_chrome();
+            render_current_slide(false);
+        }
+        break;
+    }
+}
+
+void MarkdownSlideRenderer::start_mirrored_job(int slide, int element, const std::string &command)
+{
+    auto job = std::make_unique<ShellJob>(command);
+    if (element < 0)
+    {
+        int rows, columns;
+        ShellPopup::output_size(renderer->get_screen_width(), renderer->get_screen_height(), rows, columns);
+        job->start_mirror(rows);
+        mirrored_popup = std::make_unique<ShellPopup>(renderer->get_screen_width(), renderer->get_screen_height());
+        mirrored_popup->show_mirror(std::move(job));
+        return;
+    }
+
+    // Only into the placeholder the presenter ran it from
+    if (slide < 0 || slide >= slides.get_slide_count() || element >= (int)slides.get_slide(slide).size())
+        return;
+    SlideElement &output = slides.get_slide(slide)[element];
+    if (output.type != ElementType::SHELL_OUTPUT)
+        return;
+
+    output.executed = true;
+    InlinePane &pane = inline_panes[{slide, element}];
+    job->start_mirror(output.max_output_lines);
+    pane.job = std::move(job);
+    pane.view.set_buffer(&pane.job->get_output());
+    scrolled_pane = {slide, element};
+}
+
+ShellJob *MarkdownSlideRenderer::find_mirrored_job(int slide, int element)
+{
+    if (element < 0)
+        return mirrored_popup ? &mirrored_popup->get_job() : nullptr;
+    auto found = inline_panes.find({slide, element});
+    return found == inline_panes.end() ? nullptr : found->second.job.get();
+}
+
+void MarkdownSlideRenderer::draw_mirrored_job(int slide, int element)
+{
+    if (element < 0)
+    {
+        if (mirrored_popup)
+            mirrored_popup->update_mirror();
+        renderer->refresh_display();
+        return;
+    }
+
+    // Like the presenter's own panes: off-screen ones only collect output
+    auto found = inline_panes.find({slide, element});
+    if (found == inline_panes.end())
+        return;
+    found->second.view.update();
+    if (slide == current_slide)
+    {
+        draw_inline_pane(slide, element);
+        renderer->refresh_display();
+    }
+}
+
+void MarkdownSlideRenderer::draw_presenter_notes()
+{
+    std::vector<std::string> notes;
+    for (const auto &element : slides.get_slide(current_slide))
+    {
+        if (element.type == ElementType::NOTE)
+            notes.push_back(element.content);
+    }
+
+    std::string next = "Last slide";
+    if (current_slide + 1 < slides.get_slide_count())
+        next = "Next " + std::to_string(current_slide + 2) + ": " + slide_title(slides.get_slide(current_slide + 1));
+    if (size_t followers = presenter_link.get_follower_count())
+        next += " | " + std::to_string(followers) + " following";
+    renderer->draw_notes_panel(notes, next);
+}
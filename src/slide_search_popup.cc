@@ -0,0 +1,282 @@
+#include "slide_search_popup.hh"
+#include "event_loop.hh"
+#include "input_recorder.hh"
+#include <ncurses.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+SlideSearchPopup::SlideSearchPopup(int screen_width, int screen_height)
+    : index(nullptr), slides(nullptr), match_count(0), selected(0), chosen(-1)
+{
+    compute_geometry(screen_width, screen_height);
+}
+
+void SlideSearchPopup::compute_geometry(int screen_width, int screen_height)
+{
+    popup_width = std::min(screen_width - 4, 100);
+    popup_height = std::min(screen_height - 4, 24);
+    popup_x = (screen_width - popup_width) / 2;
+    popup_y = (screen_height - popup_height) / 2;
+}
+
+void SlideSearchPopup::set_resize_handler(std::function<void()> handler)
+{
+    resize_handler = std::move(handler);
+}
+
+void SlideSearchPopup::relayout(int screen_width, int screen_height)
+{
+    compute_geometry(screen_width, screen_height);
+    run_query(); // as many results as now fit
+    draw();
+}
+
+int SlideSearchPopup::show(EventLoop &loop, DeckIndex &deck_index, const SlideCollection &deck)
+{
+    index = &deck_index;
+    slides = &deck;
+    draw();
+    refresh();
+
+    loop.run_modal([this, &loop]()
+                   { handle_input(loop); });
+
+    clear_popup_area();
+    return chosen;
+}
+
+void SlideSearchPopup::run_query()
+{
+    // Rows between the prompt and status lines and the bottom border
+    size_t visible = (size_t)std::max(popup_height - 4, 0);
+    query = DeckIndex::parse_query(input);
+    match_count = index->search(query, visible, results);
+    selected = std::min(selected, std::max((int)results.size() - 1, 0));
+}
+
+void SlideSearchPopup::draw()
+{
+    attron(COLOR_PAIR(0));
+    for (int i = 0; i < popup_height; ++i)
+    {
+        mvhline(popup_y + i, popup_x, ' ', popup_width);
+    }
+    attroff(COLOR_PAIR(0));
+
+    attron(COLOR_PAIR(1) | A_BOLD);
+    mvhline(popup_y, popup_x, '-', popup_width);
+    mvhline(popup_y + popup_height - 1, popup_x, '-', popup_width);
+    mvvline(popup_y + 1, popup_x, '|', popup_height - 2);
+    mvvline(popup_y + 1, popup_x + popup_width - 1, '|', popup_height - 2);
+    mvaddnstr(popup_y, popup_x + 2, "[ Search slides ]", popup_width - 4);
+    mvaddnstr(popup_y + popup_height - 1, popup_x + 2, "[ ESC: Cancel | ↑↓: Select | ENTER: Go to slide ]",
+              popup_width - 4);
+    attroff(COLOR_PAIR(1) | A_BOLD);
+
+    std::string prompt = "/" + input + "_";
+    attron(COLOR_PAIR(4) | A_BOLD);
+    mvaddnstr(popup_y + 1, popup_x + 2, prompt.c_str(), popup_width - 4);
+    attroff(COLOR_PAIR(4) | A_BOLD);
+
+    std::string status;
+    if (query.terms.empty())
+        status = "Type words to find among " + std::to_string(slides->get_slide_count()) + " slides";
+    else if (match_count == 0)
+        status = "No slide matches";
+    else if (match_count > results.size())
+        status = std::to_string(match_count) + " slides match, best " + std::to_string(results.size()) + " shown";
+    else
+        status = std::to_string(match_count) + (match_count == 1 ? " slide matches" : " slides match");
+    attron(COLOR_PAIR(2));
+    mvaddnstr(popup_y + 2, popup_x + 2, status.c_str(), popup_width - 4);
+    attroff(COLOR_PAIR(2));
+
+    for (int row = 0; row < (int)results.size(); ++row)
+    {
+        draw_result(row, results[row], row == selected);
+    }
+}
+
+void SlideSearchPopup::draw_result(int row, const DeckIndex::Result &result, bool is_selected)
+{
+    int y = popup_y + 3 + row;
+    int x = popup_x + 2;
+    int width = popup_width - 4;
+    int attrs = is_selected ? (COLOR_PAIR(4) | A_BOLD) : COLOR_PAIR(3);
+
+    char number[16];
+    snprintf(number, sizeof(number), "%s%5d  ", is_selected ? ">" : " ", result.slide + 1);
+    attron(attrs);
+    mvaddnstr(y, x, number, width);
+    attroff(attrs);
+    int used = std::min((int)strlen(number), width);
+
+    // The slide's first header names it; the line with most matches shows why it matched
+    const std::vector<SlideElement> &elements = slides->get_slide(result.slide);
+    int title = -1;
+    int best = -1;
+    size_t best_count = 0;
+    for (int i = 0; i < (int)elements.size(); ++i)
+    {
+        ElementType type = elements[i].type;
+        if (title < 0 && (type == ElementType::HEADER1 || type == ElementType::HEADER2 ||
+                          type == ElementType::HEADER3))
+        {
+            title = i;
+            continue;
+        }
+        if (type == ElementType::SHELL_OUTPUT || type == ElementType::NOTE)
+            continue;
+        DeckIndex::match_ranges(query, elements[i].content, ranges);
+        if (ranges.size() > best_count)
+        {
+            best = i;
+            best_count = ranges.size();
+        }
+    }
+
+    std::string heading = title >= 0 ? elements[title].content : "(untitled)";
+    used += draw_highlighted(y, x + used, heading, width - used, attrs | A_BOLD);
+    if (best < 0 || used + 3 >= width)
+        return;
+
+    attron(attrs);
+    mvaddnstr(y, x + used, " - ", width - used);
+    attroff(attrs);
+    used += 3;
+
+    // Start a long line shortly before its first match so the match is visible
+    const std::string &content = elements[best].content;
+    size_t start = content.find_first_not_of(' ');
+    DeckIndex::match_ranges(query, content, ranges);
+    std::string snippet;
+    if (!ranges.empty() && (int)(ranges[0].second - start) > width - used)
+    {
+        start = ranges[0].first - std::min(ranges[0].first - start, (size_t)(width - used) / 4);
+        while (start > 0 && ((unsigned char)content[start] & 0xC0) == 0x80)
+            start--; // not inside a UTF-8 sequence
+        snippet = "..." + content.substr(start);
+    }
+    else
+    {
+        snippet = content.substr(start);
+    }
+    draw_highlighted(y, x + used, snippet, width - used, attrs);
+}
+
+int SlideSearchPopup::draw_highlighted(int y, int x, const std::string &text, int width, int attrs)
+{
+    // Matched words are reversed; returns the columns used
+    DeckIndex::match_ranges(query, text, ranges);
+    int used = 0;
+    auto put = [&](size_t from, size_t to, int piece_attrs)
+    {
+        int count = std::min((int)(to - from), width - used);
+        if (count <= 0)
+            return;
+        attron(piece_attrs);
+        mvaddnstr(y, x + used, text.c_str() + from, count);
+        attroff(piece_attrs);
+        used = getcurx(stdscr) - x; // multibyte characters take fewer columns than bytes
+    };
+
+    size_t position = 0;
+    for (const auto &range : ranges)
+    {
+        put(position, range.first, attrs);
+        put(range.first, range.second, attrs | A_REVERSE);
+        position = range.second;
+    }
+    put(position, text.size(), attrs);
+    return used;
+}
+
+void SlideSearchPopup::handle_input(EventLoop &loop)
+{
+    int ch;
+    nodelay(stdscr, TRUE);
+    while (!loop.is_stopped() && (ch = InputRecorder::instance().read_key()) != ERR)
+    {
+        if (!handle_key(ch))
+        {
+            loop.stop();
+        }
+    }
+    nodelay(stdscr, FALSE);
+}
+
+bool SlideSearchPopup::handle_key(int ch)
+{
+    switch (ch)
+    {
+    case 27: // ESC: stay on the current slide
+        return false;
+
+    case '\n':
+    case '\r':
+    case KEY_ENTER:
+        if (results.empty())
+            return true;
+        chosen = results[selected].slide;
+        return false;
+
+    case KEY_RESIZE:
+        if (resize_handler)
+        {
+            resize_handler();
+        }
+        else
+        {
+            relayout(COLS, LINES);
+        }
+        refresh();
+        return true;
+
+    case KEY_UP:
+        selected = std::max(selected - 1, 0);
+        break;
+
+    case KEY_DOWN:
+        selected = std::min(selected + 1, std::max((int)results.size() - 1, 0));
+        break;
+
+    case KEY_BACKSPACE:
+    case 127:
+    case 8:
+        if (input.empty())
+            return true;
+        // A whole UTF-8 character
+        while (input.size() > 1 && ((unsigned char)input.back() & 0xC0) == 0x80)
+            input.pop_back();
+        input.pop_back();
+        selected = 0;
+        run_query();
+        break;
+
+    default:
+        // Printable ASCII and the bytes of UTF-8 characters
+        if (ch < 32 || ch > 255)
+            return true;
+        input += (char)ch;
+        selected = 0;
+        run_query();
+        break;
+    }
+
+    draw();
+    refresh();
+    return true;
+}
+
+void SlideSearchPopup::clear_popup_area()
+{
+    attron(COLOR_PAIR(0));
+    for (int i = 0; i < popup_height; ++i)
+    {
+        mvhline(popup_y + i, popup_x, ' ', popup_width);
+    }
+    attroff(COLOR_PAIR(0));
+    refresh();
+}
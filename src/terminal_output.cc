@@ -0,0 +1,237 @@
+#include "terminal_output.hh"
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <fcntl.h>
+#include <iterator>
+#include <mutex>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+    // A few full redraws fit, so drawing seldom waits for the thread
+    const int PIPE_SIZE = 1024 * 1024;
+    const int DRAIN_TIMEOUT_MS = 200;
+
+    struct State
+    {
+        FILE *stream = nullptr;
+        int read_fd = -1;
+        int control_fd = -1; // the terminal for modes and size
+        std::thread forwarder;
+
+        std::mutex mutex;
+        std::condition_variable idle;
+        bool copying = false; // read from the pipe, not yet written out
+        OutputCounters counters;
+
+        bool modes_saved = false;
+        termios saved_modes;
+        termios program_modes;
+        struct sigaction previous_actions[4];
+    };
+
+    // SIGWINCH first; the others leave the terminal as the shell had it
+    const int CAUGHT_SIGNALS[] = {SIGWINCH, SIGINT, SIGTERM, SIGTSTP};
+
+    State state;
+    volatile sig_atomic_t resized = 0;
+
+    void note_resize(int)
+    {
+        resized = 1;
+    }
+
+    // What ncurses does when it draws to the terminal itself. Runs with the
+    // signal unblocked, so SIGTSTP stops in raise() until SIGCONT.
+    void restore_and_raise(int signal_number)
+    {
+        int saved_errno = errno;
+        if (state.modes_saved)
+            tcsetattr(state.control_fd, TCSADRAIN, &state.saved_modes);
+        struct sigaction action = {}, caught;
+        action.sa_handler = SIG_DFL;
+        sigaction(signal_number, &action, &caught);
+        raise(signal_number);
+
+        // Continued after a suspend: the screen is redrawn as after a resize
+        if (state.modes_saved)
+            tcsetattr(state.control_fd, TCSADRAIN, &state.program_modes);
+        sigaction(signal_number, &caught, nullptr);
+        resized = 1;
+        errno = saved_errno;
+    }
+
+    void forward()
+    {
+        char buffer[64 * 1024];
+        for (;;)
+        {
+            ssize_t length;
+            {
+                // Taken under the lock, so totals() never misses bytes in flight
+                std::lock_guard<std::mutex> lock(state.mutex);
+                length = read(state.read_fd, buffer, sizeof(buffer));
+                state.copying = length > 0;
+            }
+            if (length < 0 && errno == EAGAIN)
+            {
+                pollfd readable = {state.read_fd, POLLIN, 0};
+                poll(&readable, 1, -1);
+                continue;
+            }
+            if (length < 0 && errno == EINTR)
+                continue;
+            if (length <= 0)
+                break;
+
+            OutputCounters written;
+            for (ssize_t offset = 0; offset < length;)
+            {
+                ssize_t count = write(STDOUT_FILENO, buffer + offset, length - offset);
+                if (count < 0 && errno == EINTR)
+                    continue;
+                // A terminal that went away: keep draining so drawing never blocks
+                if (count <= 0)
+                    break;
+                offset += count;
+                written.bytes += count;
+                written.writes++;
+            }
+
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.counters.bytes += written.bytes;
+            state.counters.writes += written.writes;
+            state.copying = false;
+            state.idle.notify_all();
+        }
+
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.copying = false;
+        state.idle.notify_all();
+    }
+
+    int pending_bytes()
+    {
+        int pending = 0;
+        if (ioctl(state.read_fd, FIONREAD, &pending) < 0)
+            return 0;
+        return pending;
+    }
+}
+
+FILE *TerminalOutput::open()
+{
+    if (state.stream)
+        return state.stream;
+
+    // Close-on-exec, or a command's shell would keep the pipe open past close()
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0)
+        return nullptr;
+    state.stream = fdopen(fds[1], "w");
+    if (!state.stream)
+    {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return nullptr;
+    }
+    fcntl(fds[0], F_SETPIPE_SZ, PIPE_SIZE);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    state.read_fd = fds[0];
+
+    // Keys are read from stdin; stderr stands in when stdout is redirected
+    state.control_fd = isatty(STDOUT_FILENO) ? STDOUT_FILENO : STDERR_FILENO;
+    if (tcgetattr(state.control_fd, &state.saved_modes) == 0)
+    {
+        // What cbreak() and noecho() would set on the terminal itself
+        termios &modes = state.program_modes;
+        modes = state.saved_modes;
+        modes.c_lflag &= ~(ICANON | ECHO);
+        modes.c_lflag |= ISIG;
+        modes.c_iflag &= ~ICRNL;
+        modes.c_cc[VMIN] = 1;
+        modes.c_cc[VTIME] = 0;
+        state.modes_saved = tcsetattr(state.control_fd, TCSADRAIN, &modes) == 0;
+    }
+
+    // ncurses leaves signals that are already caught to their handler, so
+    // these are set before newterm(). SA_RESTART keeps a blocking getch()
+    // going; epoll_wait() is interrupted regardless.
+    for (size_t i = 0; i < std::size(CAUGHT_SIGNALS); ++i)
+    {
+        struct sigaction &previous = state.previous_actions[i];
+        sigaction(CAUGHT_SIGNALS[i], nullptr, &previous);
+        if (i > 0 && previous.sa_handler != SIG_DFL)
+            continue;
+        struct sigaction action = {};
+        action.sa_handler = i == 0 ? note_resize : restore_and_raise;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = i == 0 ? SA_RESTART : SA_RESTART | SA_NODEFER;
+        sigaction(CAUGHT_SIGNALS[i], &action, nullptr);
+    }
+
+    // Signals stay with the UI thread
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &previous);
+    state.forwarder = std::thread(forward);
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    return state.stream;
+}
+
+void TerminalOutput::close()
+{
+    if (!state.stream)
+        return;
+
+    // EOF on the pipe ends the thread once the last bytes are out
+    fclose(state.stream);
+    state.stream = nullptr;
+    state.forwarder.join();
+    ::close(state.read_fd);
+    state.read_fd = -1;
+
+    for (size_t i = 0; i < std::size(CAUGHT_SIGNALS); ++i)
+    {
+        sigaction(CAUGHT_SIGNALS[i], &state.previous_actions[i], nullptr);
+    }
+    if (state.modes_saved)
+        tcsetattr(state.control_fd, TCSADRAIN, &state.saved_modes);
+    state.modes_saved = false;
+}
+
+OutputCounters TerminalOutput::totals()
+{
+    // Draws come from this thread only, so once the pipe is empty and the
+    // thread idle every byte drawn so far has been counted
+    std::unique_lock<std::mutex> lock(state.mutex);
+    if (state.read_fd >= 0)
+        state.idle.wait_for(lock, std::chrono::milliseconds(DRAIN_TIMEOUT_MS),
+                           []()
+                           { return !state.copying && pending_bytes() == 0; });
+    return state.counters;
+}
+
+bool TerminalOutput::get_size(int &lines, int &cols)
+{
+    winsize size;
+    int fd = state.control_fd >= 0 ? state.control_fd : STDOUT_FILENO;
+    if (ioctl(fd, TIOCGWINSZ, &size) < 0 || size.ws_row == 0 || size.ws_col == 0)
+        return false;
+    lines = size.ws_row;
+    cols = size.ws_col;
+    return true;
+}
+
+bool TerminalOutput::take_resize(int &lines, int &cols)
+{
+    if (!resized)
+        return false;
+    resized = 0;
+    return get_size(lines, cols);
+}
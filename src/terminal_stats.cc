@@ -0,0 +1,132 @@
+#include "terminal_stats.hh"
+#include "terminal_output.hh"
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+    OutputCounters difference(const OutputCounters &end, const OutputCounters &start)
+    {
+        OutputCounters result;
+        result.bytes = end.bytes - start.bytes;
+        result.writes = end.writes - start.writes;
+        return result;
+    }
+
+    std::string format_bytes(uint64_t bytes)
+    {
+        char buffer[32];
+        if (bytes >= 1024 * 1024)
+            snprintf(buffer, sizeof(buffer), "%.1fM", bytes / (1024.0 * 1024.0));
+        else if (bytes >= 1024)
+            snprintf(buffer, sizeof(buffer), "%.1fK", bytes / 1024.0);
+        else
+            snprintf(buffer, sizeof(buffer), "%lluB", (unsigned long long)bytes);
+        return buffer;
+    }
+}
+
+TerminalStats::TerminalStats() : action_count(0), action_open(false)
+{
+}
+
+void TerminalStats::begin_action()
+{
+    action_start = TerminalOutput::totals();
+    action_open = true;
+}
+
+void TerminalStats::end_action()
+{
+    if (!action_open)
+        return;
+
+    action_open = false;
+    last_action = difference(TerminalOutput::totals(), action_start);
+    action_count++;
+    action_total.bytes += last_action.bytes;
+    action_total.writes += last_action.writes;
+    max_action.bytes = std::max(max_action.bytes, last_action.bytes);
+    max_action.writes = std::max(max_action.writes, last_action.writes);
+}
+
+void TerminalStats::begin_frame()
+{
+    frame_start = TerminalOutput::totals();
+}
+
+void TerminalStats::end_frame(int slide_index)
+{
+    if (slide_index < 0)
+        return;
+
+    OutputCounters frame = difference(TerminalOutput::totals(), frame_start);
+    if (slide_index >= (int)slides.size())
+        slides.resize(slide_index + 1);
+
+    SlideOutputStats &stats = slides[slide_index];
+    stats.frames++;
+    stats.total.bytes += frame.bytes;
+    stats.total.writes += frame.writes;
+    stats.max_frame.bytes = std::max(stats.max_frame.bytes, frame.bytes);
+    stats.max_frame.writes = std::max(stats.max_frame.writes, frame.writes);
+}
+
+const OutputCounters &TerminalStats::get_last_action() const
+{
+    return last_action;
+}
+
+std::string TerminalStats::format_overlay() const
+{
+    OutputCounters all = TerminalOutput::totals();
+    return "Out: " + format_bytes(last_action.bytes) + "/" + std::to_string(last_action.writes) +
+           "w (total " + format_bytes(all.bytes) + ")";
+}
+
+std::string TerminalStats::format_summary(int top_slides) const
+{
+    OutputCounters all = TerminalOutput::totals();
+    std::string result;
+    char line[160];
+
+    snprintf(line, sizeof(line), "Terminal output: %llu bytes in %llu writes\n",
+             (unsigned long long)all.bytes, (unsigned long long)all.writes);
+    result += line;
+
+    if (action_count > 0)
+    {
+        snprintf(line, sizeof(line), "Per action: %llu actions, avg %llu bytes, max %llu bytes / %llu writes\n",
+                 (unsigned long long)action_count, (unsigned long long)(action_total.bytes / action_count),
+                 (unsigned long long)max_action.bytes, (unsigned long long)max_action.writes);
+        result += line;
+    }
+
+    std::vector<int> order;
+    for (size_t i = 0; i < slides.size(); ++i)
+    {
+        if (slides[i].frames > 0)
+            order.push_back((int)i);
+    }
+    if (order.empty())
+        return result;
+
+    // Heaviest single frame first, so slides that flood the link lead the list
+    std::sort(order.begin(), order.end(), [this](int a, int b)
+              { return slides[a].max_frame.bytes > slides[b].max_frame.bytes; });
+    if ((int)order.size() > top_slides)
+        order.resize(top_slides);
+
+    result += "Heaviest slides (bytes per frame):\n";
+    result += "  slide   frames   max bytes  max writes   avg bytes\n";
+    for (int index : order)
+    {
+        const SlideOutputStats &stats = slides[index];
+        snprintf(line, sizeof(line), "  %5d   %6llu  %10llu  %10llu  %10llu\n", index + 1,
+                 (unsigned long long)stats.frames, (unsigned long long)stats.max_frame.bytes,
+                 (unsigned long long)stats.max_frame.writes,
+                 (unsigned long long)(stats.total.bytes / stats.frames));
+        result += line;
+    }
+    return result;
+}
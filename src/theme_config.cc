@@ -1,7 +1,120 @@
 #include "theme_config.hh"
 #include <ncurses.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
 
-ThemeManager::ThemeManager() : current_theme(Theme::DARK)
+namespace
+{
+    const int CUBE_LEVELS[] = {0, 95, 135, 175, 215, 255};
+
+    int rgb_of_palette_index(int index)
+    {
+        static const int system_colors[] = {0x000000, 0x800000, 0x008000, 0x808000, 0x000080, 0x800080,
+                                            0x008080, 0xc0c0c0, 0x808080, 0xff0000, 0x00ff00, 0xffff00,
+                                            0x0000ff, 0xff00ff, 0x00ffff, 0xffffff};
+        if (index < 16)
+            return system_colors[index];
+        if (index < 232)
+        {
+            index -= 16;
+            return (CUBE_LEVELS[index / 36] << 16) | (CUBE_LEVELS[(index / 6) % 6] << 8) | CUBE_LEVELS[index % 6];
+        }
+        int gray = 8 + (index - 232) * 10;
+        return (gray << 16) | (gray << 8) | gray;
+    }
+
+    int nearest_basic_color(int rgb)
+    {
+        // COLOR_RED, COLOR_GREEN and COLOR_BLUE are bits 0, 1 and 2
+        int color = 0;
+        if (((rgb >> 16) & 0xff) > 0x7f)
+            color |= COLOR_RED;
+        if (((rgb >> 8) & 0xff) > 0x7f)
+            color |= COLOR_GREEN;
+        if ((rgb & 0xff) > 0x7f)
+            color |= COLOR_BLUE;
+        return color;
+    }
+
+    int nearest_cube_level(int component)
+    {
+        int best = 0;
+        for (int i = 1; i < 6; ++i)
+        {
+            if (std::abs(CUBE_LEVELS[i] - component) < std::abs(CUBE_LEVELS[best] - component))
+                best = i;
+        }
+        return best;
+    }
+
+    int color_distance(int a, int b)
+    {
+        int dr = ((a >> 16) & 0xff) - ((b >> 16) & 0xff);
+        int dg = ((a >> 8) & 0xff) - ((b >> 8) & 0xff);
+        int db = (a & 0xff) - (b & 0xff);
+        return dr * dr + dg * dg + db * db;
+    }
+
+    int nearest_256_color(int rgb)
+    {
+        int r = nearest_cube_level((rgb >> 16) & 0xff);
+        int g = nearest_cube_level((rgb >> 8) & 0xff);
+        int b = nearest_cube_level(rgb & 0xff);
+        int cube_index = 16 + 36 * r + 6 * g + b;
+
+        int average = (((rgb >> 16) & 0xff) + ((rgb >> 8) & 0xff) + (rgb & 0xff)) / 3;
+        int gray_index = 232 + std::min(std::max((average - 3) / 10, 0), 23);
+
+        return color_distance(rgb, rgb_of_palette_index(cube_index)) <=
+                       color_distance(rgb, rgb_of_palette_index(gray_index))
+                   ? cube_index
+                   : gray_index;
+    }
+
+    std::string trim(const std::string &text)
+    {
+        size_t start = text.find_first_not_of(" \t\r");
+        if (start == std::string::npos)
+            return "";
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(start, end - start + 1);
+    }
+
+    bool parse_color(std::string value, int &color)
+    {
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+        static const char *names[] = {"black", "red", "green", "yellow", "blue", "magenta", "cyan", "white"};
+        for (int i = 0; i < 8; ++i)
+        {
+            if (value == names[i])
+            {
+                color = i;
+                return true;
+            }
+        }
+
+        char *end = nullptr;
+        if (value.size() == 7 && value[0] == '#')
+        {
+            long rgb = std::strtol(value.c_str() + 1, &end, 16);
+            if (*end != '\0')
+                return false;
+            color = THEME_RGB | static_cast<int>(rgb);
+            return true;
+        }
+
+        long index = std::strtol(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || index < 0 || index > 255)
+            return false;
+        color = static_cast<int>(index);
+        return true;
+    }
+}
+
+ThemeManager::ThemeManager() : current_theme(0), background_set(false)
 {
     themes = {
         {COLOR_BLACK, COLOR_CYAN, COLOR_YELLOW, COLOR_WHITE, COLOR_GREEN, COLOR_MAGENTA, "Dark"},
@@ -10,40 +123,192 @@ ThemeManager::ThemeManager() : current_theme(Theme::DARK)
         {COLOR_BLACK, COLOR_YELLOW, COLOR_CYAN, COLOR_WHITE, COLOR_MAGENTA, COLOR_RED, "Retro"}};
 }
 
-void ThemeManager::setup_theme(Theme theme)
+int ThemeManager::resolve_color(int value)
+{
+    if (value & THEME_RGB)
+    {
+        int rgb = value & 0xffffff;
+        if (COLORS >= 0x1000000)
+            return rgb; // direct-colour terminal: the colour number is the RGB value
+        if (COLORS >= 256)
+            return nearest_256_color(rgb);
+        return nearest_basic_color(rgb);
+    }
+
+    if (value < COLORS)
+        return value;
+    return nearest_basic_color(rgb_of_palette_index(value));
+}
+
+int ThemeManager::rgb_of_color(int value)
+{
+    return value & THEME_RGB ? value & 0xffffff : rgb_of_palette_index(value & 0xff);
+}
+
+int ThemeManager::nearest_palette_index(int rgb)
+{
+    return nearest_256_color(rgb);
+}
+
+void ThemeManager::init_color_pair(int pair, int foreground, int background)
 {
-    current_theme = theme;
-    const auto &theme_config = themes[static_cast<int>(theme)];
+#if defined(NCURSES_EXT_COLORS)
+    init_extended_pair(pair, foreground, background);
+#else
+    init_pair(pair, foreground, background);
+#endif
+}
 
-    init_pair(1, theme_config.title_color, theme_config.bg_color);
-    init_pair(2, theme_config.subtitle_color, theme_config.bg_color);
-    init_pair(3, theme_config.text_color, theme_config.bg_color);
-    init_pair(4, theme_config.accent_color, theme_config.bg_color);
-    init_pair(5, theme_config.bg_color, theme_config.text_color);
-    init_pair(6, theme_config.code_color, theme_config.bg_color);
-    init_pair(7, COLOR_GREEN, theme_config.bg_color);
-    init_pair(8, COLOR_YELLOW, theme_config.bg_color);
-    init_pair(9, COLOR_RED, theme_config.bg_color);
-    init_pair(0, theme_config.text_color, theme_config.bg_color);
+void ThemeManager::pair_colors(const ThemeConfig &theme, int pair, int &foreground, int &background)
+{
+    static const int status_colors[] = {COLOR_GREEN, COLOR_YELLOW, COLOR_RED};
+    background = theme.bg_color;
+    switch (pair)
+    {
+    case 1:
+        foreground = theme.title_color;
+        break;
+    case 2:
+        foreground = theme.subtitle_color;
+        break;
+    case 4:
+        foreground = theme.accent_color;
+        break;
+    case 5:
+        foreground = theme.bg_color;
+        background = theme.text_color;
+        break;
+    case 6:
+        foreground = theme.code_color;
+        break;
+    case 7:
+    case 8:
+    case 9:
+        foreground = status_colors[pair - 7];
+        break;
+    default:
+        foreground = theme.text_color;
+        break;
+    }
+}
 
-    refresh();
-    // Set window background
-    wbkgd(stdscr, ' ' | COLOR_PAIR(9));
-    refresh();
+void ThemeManager::setup_theme(int theme_index)
+{
+    current_theme = theme_index;
+
+    // Redefining a pair makes ncurses repaint every cell drawn with it on the
+    // next refresh, so switching themes recolours the frame without redrawing it
+    for (int pair = 0; pair <= 9; ++pair)
+    {
+        int foreground, background;
+        pair_colors(themes[theme_index], pair, foreground, background);
+        init_color_pair(pair, resolve_color(foreground), resolve_color(background));
+    }
+
+    if (!background_set)
+    {
+        // Set window background
+        wbkgd(stdscr, ' ' | COLOR_PAIR(9));
+        background_set = true;
+    }
 }
 
 void ThemeManager::cycle_theme()
 {
-    current_theme = static_cast<Theme>((static_cast<int>(current_theme) + 1) % themes.size());
-    setup_theme(current_theme);
+    setup_theme((current_theme + 1) % themes.size());
 }
 
-Theme ThemeManager::get_current_theme() const
+int ThemeManager::get_current_theme() const
 {
     return current_theme;
 }
 
 const char *ThemeManager::get_current_theme_name() const
 {
-    return themes[static_cast<int>(current_theme)].name;
+    return get_theme_name(current_theme);
+}
+
+int ThemeManager::get_theme_count() const
+{
+    return static_cast<int>(themes.size());
+}
+
+const char *ThemeManager::get_theme_name(int theme_index) const
+{
+    return themes[theme_index].name.c_str();
+}
+
+const ThemeConfig &ThemeManager::get_theme_config(int theme_index) const
+{
+    return themes[theme_index];
+}
+
+bool ThemeManager::load_palette_file(const std::string &filename, std::string &error)
+{
+    std::ifstream file(filename);
+    if (!file)
+    {
+        error = "Cannot open palette file: " + filename;
+        return false;
+    }
+
+    std::vector<ThemeConfig> loaded;
+    std::string line;
+    int line_number = 0;
+
+    while (std::getline(file, line))
+    {
+        line_number++;
+        line = trim(line);
+        if (line.empty() || line[0] == '#' || line[0] == ';')
+            continue;
+
+        if (line.front() == '[' && line.back() == ']')
+        {
+            // Unset colours fall back to the Dark theme
+            ThemeConfig theme = themes[static_cast<int>(Theme::DARK)];
+            theme.name = trim(line.substr(1, line.size() - 2));
+            loaded.push_back(theme);
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos || loaded.empty())
+        {
+            error = filename + ":" + std::to_string(line_number) + ": expected [name] or key = colour";
+            return false;
+        }
+
+        std::string key = trim(line.substr(0, equals));
+        int color;
+        if (!parse_color(trim(line.substr(equals + 1)), color))
+        {
+            error = filename + ":" + std::to_string(line_number) + ": invalid colour";
+            return false;
+        }
+
+        static const std::map<std::string, int ThemeConfig::*> keys = {
+            {"background", &ThemeConfig::bg_color}, {"title", &ThemeConfig::title_color},
+            {"subtitle", &ThemeConfig::subtitle_color}, {"text", &ThemeConfig::text_color},
+            {"accent", &ThemeConfig::accent_color}, {"code", &ThemeConfig::code_color}};
+        auto field = keys.find(key);
+        if (field == keys.end())
+        {
+            error = filename + ":" + std::to_string(line_number) + ": unknown key '" + key + "'";
+            return false;
+        }
+        loaded.back().*(field->second) = color;
+    }
+
+    for (const auto &theme : loaded)
+    {
+        auto existing = std::find_if(themes.begin(), themes.end(),
+                                     [&theme](const ThemeConfig &t)
+                                     { return t.name == theme.name; });
+        if (existing != themes.end())
+            *existing = theme;
+        else
+            themes.push_back(theme);
+    }
+    return true;
 }
@@ -0,0 +1,95 @@
+#include "trace_recorder.hh"
+#include <cstdio>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+TraceRecorder::TraceRecorder() : enabled(false), origin(std::chrono::steady_clock::now())
+{
+}
+
+TraceRecorder &TraceRecorder::instance()
+{
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+bool TraceRecorder::open(const std::string &name)
+{
+    // Fail early rather than after a whole talk
+    FILE *file = fopen(name.c_str(), "w");
+    if (!file)
+        return false;
+    fclose(file);
+
+    filename = name;
+    origin = std::chrono::steady_clock::now();
+    events.reserve(4096);
+    enabled = true;
+    return true;
+}
+
+uint64_t TraceRecorder::now_us() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - origin)
+        .count();
+}
+
+int TraceRecorder::current_thread_id()
+{
+    static thread_local int thread_id = static_cast<int>(syscall(SYS_gettid));
+    return thread_id;
+}
+
+void TraceRecorder::complete(const char *name, const char *category, uint64_t start_us,
+                             uint64_t end_us, int arg)
+{
+    if (!enabled)
+        return;
+
+    TraceEvent event = {name, category, 'X', start_us, end_us - start_us, current_thread_id(), arg};
+    std::lock_guard<std::mutex> lock(events_mutex);
+    events.push_back(event);
+}
+
+void TraceRecorder::instant(const char *name, const char *category, int arg)
+{
+    if (!enabled)
+        return;
+
+    TraceEvent event = {name, category, 'i', now_us(), 0, current_thread_id(), arg};
+    std::lock_guard<std::mutex> lock(events_mutex);
+    events.push_back(event);
+}
+
+bool TraceRecorder::close()
+{
+    if (!enabled)
+        return true;
+    enabled = false;
+
+    FILE *file = fopen(filename.c_str(), "w");
+    if (!file)
+        return false;
+
+    int pid = static_cast<int>(getpid());
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"mdslides\"}}", pid);
+    for (const auto &event : events)
+    {
+        fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"%c\", \"ts\": %llu, ",
+                event.name, event.category, event.phase, (unsigned long long)event.timestamp_us);
+        if (event.phase == 'X')
+            fprintf(file, "\"dur\": %llu, ", (unsigned long long)event.duration_us);
+        else
+            fprintf(file, "\"s\": \"t\", ");
+        fprintf(file, "\"pid\": %d, \"tid\": %d", pid, event.thread_id);
+        if (event.arg >= 0)
+            fprintf(file, ", \"args\": {\"value\": %d}", event.arg);
+        fprintf(file, "}");
+    }
+    fprintf(file, "\n]}\n");
+    events.clear();
+
+    return fclose(file) == 0;
+}